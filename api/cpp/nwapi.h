@@ -61,6 +61,7 @@ struct NWplugindata
     const char* internalName;
 };
 
+/* Same layout as the blocks inside NEWorld, so arrays of blocks are passed by pointer without conversion */
 struct NWblockdata
 {
     uint32_t id : 12;
@@ -68,6 +69,11 @@ struct NWblockdata
     uint32_t state : 16;
 };
 
+typedef char NWblockdataSizeCheck[sizeof(struct NWblockdata) == sizeof(uint32_t) ? 1 : -1];
+
+/* Opaque handle of a world */
+struct NWworld;
+
 struct NWblocktype
 {
     const char* blockname;
@@ -79,11 +85,83 @@ struct NWblocktype
 };
 
 typedef void NWAPICALL NWchunkgenerator(const NWvec3i*, NWblockdata*, int32_t);
+/* Generate `count` chunks in one call: chunk i is at pos[i], its blocks at blocks[i] */
+typedef void NWAPICALL NWchunkbatchgenerator(const NWvec3i* pos, NWblockdata* const* blocks, int32_t count,
+                                             int32_t daylightBrightness);
+
+/* Plugin events, delivered once per tick with all events of the tick in one call */
+#define NW_EVENT_BLOCK_CHANGED 0  /* events: NWblockchange[count] */
+#define NW_EVENT_CHUNK_LOADED 1   /* events: NWvec3i[count] (chunk positions) */
+#define NW_EVENT_CHUNK_UNLOADED 2 /* events: NWvec3i[count] (chunk positions) */
+#define NW_EVENT_TICK 3           /* events: int64_t[1] (tick number), world: null */
+
+struct NWblockchange
+{
+    NWvec3i pos;
+    NWblockdata block; /* The new block */
+};
 
+typedef void NWAPICALL NWeventhandler(NWworld* world, const void* events, int32_t count, void* userData);
+
+typedef void NWAPICALL NWtaskfunction(void* userData);
+
+/* Chunk generator capabilities */
+/* The generator may be called from several threads at once. Otherwise calls are serialized. */
+#define NW_CHUNKGEN_REENTRANT 1
+
+/* Largest data a plugin can attach to one block (bytes) */
+#define NW_ATTACHMENT_MAX_LENGTH 65536
+
+    /* Get the world plugins work on by default, nwGetBlock and nwSetBlock use it */
+    NWAPIENTRY NWworld* NWAPICALL nwGetCurrentWorld();
     NWAPIENTRY NWblockdata NWAPICALL nwGetBlock(const NWvec3i* pos);
+    /* Block edits don't wait for the disk, they survive a crash once the server journals them (within milliseconds) */
     NWAPIENTRY int32_t NWAPICALL nwSetBlock(const NWvec3i* pos, NWblockdata block);
+    NWAPIENTRY NWblockdata NWAPICALL nwWorldGetBlock(NWworld* world, const NWvec3i* pos);
+    NWAPIENTRY int32_t NWAPICALL nwWorldSetBlock(NWworld* world, const NWvec3i* pos, NWblockdata block);
+    /* Get the blocks at `count` positions into `blocks`, return the number of positions in loaded chunks.
+       Blocks of unloaded chunks are left untouched. Return -1 if `count` is negative or an array is null. */
+    NWAPIENTRY int32_t NWAPICALL nwWorldGetBlocks(NWworld* world, const NWvec3i* pos, int32_t count, NWblockdata* blocks);
     NWAPIENTRY int32_t NWAPICALL nwRegisterBlock(const NWblocktype*);
     NWAPIENTRY int32_t NWAPICALL nwRegisterChunkGenerator(NWchunkgenerator* const generator);
+    /* Register a chunk generator with capability flags (NW_CHUNKGEN_*), `batchGenerator` may be null */
+    NWAPIENTRY int32_t NWAPICALL nwRegisterChunkGeneratorEx(NWchunkgenerator* const generator,
+                                                            NWchunkbatchgenerator* const batchGenerator, int32_t flags);
+
+    /* Subscribe to an event (NW_EVENT_*), return the subscription ID or -1 on failure.
+       Handlers run on the tick thread, subscriptions must be changed from the tick thread too. */
+    NWAPIENTRY int32_t NWAPICALL nwSubscribe(int32_t event, NWeventhandler* const handler, void* userData);
+    /* Cancel a subscription, may be called from a handler. Return 0 for success. */
+    NWAPIENTRY int32_t NWAPICALL nwUnsubscribe(int32_t subscription);
+    /* Run `job` on a server worker thread, then `completion` (may be null) on the tick thread.
+       The job must not touch worlds or subscriptions, pass the results to the completion.
+       Return the task ID or -1 on failure. */
+    NWAPIENTRY int32_t NWAPICALL nwScheduleAsync(NWtaskfunction* const job, NWtaskfunction* const completion, void* userData);
+    /* Run `job` on the tick thread after `delay` ticks (0 for the next tick). Return the task ID or -1 on failure. */
+    NWAPIENTRY int32_t NWAPICALL nwScheduleOnTick(NWtaskfunction* const job, int32_t delay, void* userData);
+    /* Cancel a task, a running job finishes but its completion is not called. Return 0 for success.
+       Tasks of a plugin are cancelled when it unloads. */
+    NWAPIENTRY int32_t NWAPICALL nwCancelTask(int32_t task);
+    /* Bulk edits of the box [min, max] (inclusive), one call for the whole box.
+       Blocks in chunks which are not loaded are skipped. Return the number of changed blocks, at most INT32_MAX,
+       or -1 if the world, the box or the region buffer is null. */
+    NWAPIENTRY int32_t NWAPICALL nwFillColumn(NWworld* world, int32_t x, int32_t z, int32_t bottom, int32_t top, NWblockdata block);
+    NWAPIENTRY int32_t NWAPICALL nwFillBox(NWworld* world, const NWvec3i* min, const NWvec3i* max, NWblockdata block);
+    NWAPIENTRY int32_t NWAPICALL nwReplaceBlocks(NWworld* world, const NWvec3i* min, const NWvec3i* max, int32_t fromID, NWblockdata block);
+    /* Region buffers hold the box like a chunk: block (x, y, z) at ((x * sizeY) + y) * sizeZ + z, relative to min */
+    NWAPIENTRY int32_t NWAPICALL nwCopyRegionIn(NWworld* world, const NWvec3i* min, const NWvec3i* max, const NWblockdata* src);
+    /* Return the number of copied blocks, blocks of unloaded chunks are left untouched in `dst` */
+    NWAPIENTRY int32_t NWAPICALL nwCopyRegionOut(NWworld* world, const NWvec3i* min, const NWvec3i* max, NWblockdata* dst);
+
+    /* Get the attachment ID of a plugin from its internal name, stable across runs */
+    NWAPIENTRY uint32_t NWAPICALL nwGetPluginID(const char* internalName);
+    /* Attach data to a block, saved with its chunk. Zero length removes the attachment.
+       Return 0 for success, 1 if the chunk is not loaded, 2 if `length` is negative, larger than
+       NW_ATTACHMENT_MAX_LENGTH or `data` is null. */
+    NWAPIENTRY int32_t NWAPICALL nwSetAttachment(NWworld* world, const NWvec3i* pos, uint32_t pluginID, const void* data, int32_t length);
+    /* Copy at most `bufferSize` bytes of the data attached to a block into `buffer`.
+       Return the length of the data, -1 if there is none, or -2 if `bufferSize` is negative or `buffer` is null. */
+    NWAPIENTRY int32_t NWAPICALL nwGetAttachment(NWworld* world, const NWvec3i* pos, uint32_t pluginID, void* buffer, int32_t bufferSize);
 
 #ifdef __cplusplus
 }
@@ -26,7 +26,6 @@
 std::string hostIp = "127.0.0.1";
 boost::asio::io_service ioService;
 std::shared_ptr<Session> session;
-const int updateInterval = 10;
 const int Port = 8090; //TODO: read it from an address
 void disconnect()
 {
@@ -67,12 +66,5 @@ void errorHandle(const tcp::socket&, boost::system::error_code ec)
 
 void Session::doUpdate()
 {
-    return;
-    auto self(shared_from_this());
-    boost::asio::deadline_timer(m_socket.get_io_service(), boost::posix_time::microseconds(updateInterval)).async_wait(
-        [this, self](boost::system::error_code)
-    {
-        //Update world here
-        doWrite();
-    });
+    //Update world here
 }
@@ -20,13 +20,14 @@
 #include "networkstructures.h"
 #include <cassert>
 
-#define DEFAULT_IMPLEMENT(classname) void classname::process() { assert(false); }
+#define DEFAULT_IMPLEMENT(classname) bool classname::process() const { assert(false); return false; }
 
 //Define the ways the data packets process.
 
-void ChatPacket::process()
+bool ChatPacket::process() const
 {
     //Do something like printing it to the screen.
+    return true;
 }
 
 //The below is server side, no need for client to implement.
@@ -0,0 +1,187 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Chunk generation benchmark: runs DefaultChunkGen and the generator registered by plugins/ over a region,
+// on one thread and on all of them. Usage: nwgenbench [radius = 16] [height = 2] [threads = 0 (all)]
+// The region is x, z in [-radius, radius] and y in [-height, height - 1] (chunks).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <common.h>
+#include <logger.h>
+#include <blockmanager.h>
+#include <pluginmanager.h>
+#include <pluginapi.h>
+#include <chunkloader.h>
+#include <threadpool.h>
+
+namespace
+{
+    // Heap allocations made by the current thread, plugins sharing the C++ runtime included
+    thread_local uint64_t allocationCount = 0;
+}
+
+void* operator new(size_t size)
+{
+    allocationCount++;
+    void* res = std::malloc(size != 0 ? size : 1);
+    if (res == nullptr) throw std::bad_alloc();
+    return res;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+// Sized deallocation would otherwise reach the default operator delete with memory from std::malloc
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace
+{
+    // Chunks per generator call
+    constexpr size_t BatchSize = 16;
+    constexpr int DaylightBrightness = 15;
+
+    struct Generator
+    {
+        std::string name;
+        ChunkGenerator* generator;
+        ChunkBatchGenerator* batchGenerator;
+        int flags;
+        PluginStats* owner;
+    };
+
+    struct Result
+    {
+        double seconds;
+        uint64_t allocations;
+        uint64_t checksum;
+    };
+
+    // Word-wise FNV-1a in four independent lanes, cheap next to generation
+    uint64_t getChecksum(const BlockData* blocks)
+    {
+        uint64_t lanes[4] = { 0xcbf29ce484222325ull, 0xcbf29ce484222325ull, 0xcbf29ce484222325ull, 0xcbf29ce484222325ull };
+        for (int i = 0; i < ChunkBlockCount; i += 4)
+            for (int j = 0; j < 4; j++)
+                lanes[j] = (lanes[j] ^ blocks[i + j].getRawData()) * 0x100000001b3ull;
+        return ((lanes[0] * 31 + lanes[1]) * 31 + lanes[2]) * 31 + lanes[3];
+    }
+
+    Result run(const std::vector<Vec3i>& chunks, ThreadPool* pool)
+    {
+        const size_t threads = pool != nullptr ? pool->getThreadCount() : 1;
+        std::vector<uint64_t> checksums(chunks.size());
+        std::vector<std::vector<BlockData>> buffers(threads, std::vector<BlockData>(BatchSize * ChunkBlockCount));
+        std::atomic<size_t> next(0);
+        std::atomic<uint64_t> allocations(0);
+
+        auto worker = [&](size_t thread)
+        {
+            uint64_t allocationsBefore = allocationCount;
+            BlockData* blocks[BatchSize];
+            for (size_t i = 0; i < BatchSize; i++) blocks[i] = buffers[thread].data() + i * ChunkBlockCount;
+            for (size_t begin; (begin = next.fetch_add(BatchSize)) < chunks.size();)
+            {
+                size_t count = std::min(BatchSize, chunks.size() - begin);
+                ChunkLoader::generate(chunks.data() + begin, blocks, count, DaylightBrightness);
+                for (size_t i = 0; i < count; i++) checksums[begin + i] = getChecksum(blocks[i]);
+            }
+            allocations += allocationCount - allocationsBefore;
+        };
+
+        using Clock = std::chrono::steady_clock;
+        auto begin = Clock::now();
+        if (pool == nullptr) worker(0);
+        else
+        {
+            for (size_t i = 0; i < threads; i++) pool->post([&worker, i] { worker(i); });
+            pool->wait();
+        }
+        Result res;
+        res.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+        res.allocations = allocations;
+        res.checksum = 0xcbf29ce484222325ull;
+        for (uint64_t checksum : checksums) res.checksum = (res.checksum ^ checksum) * 0x100000001b3ull;
+        return res;
+    }
+
+    void report(const std::string& name, size_t threads, size_t chunkCount, const Result& res)
+    {
+        std::stringstream ss;
+        ss << std::hex << res.checksum;
+        infostream << name << ", " << threads << (threads == 1 ? " thread: " : " threads: ")
+                   << chunkCount / res.seconds << " chunks/s, "
+                   << res.seconds * 1e9 / (double(chunkCount) * ChunkBlockCount) << " ns/block, "
+                   << res.allocations << " allocations (" << double(res.allocations) / chunkCount << " per chunk), "
+                   << "checksum " << ss.str();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int radius = argc > 1 ? std::atoi(argv[1]) : 16;
+    const int height = argc > 2 ? std::atoi(argv[2]) : 2;
+    ThreadPool pool(argc > 3 ? size_t(std::atoi(argv[3])) : 0);
+    Logger::init("genbench");
+
+    // Columns are kept together, like the loader and the pre-generator request them
+    std::vector<Vec3i> chunks;
+    for (int x = -radius; x <= radius; x++)
+        for (int z = -radius; z <= radius; z++)
+            for (int y = -height; y < height; y++)
+                chunks.push_back(Vec3i(x, y, z));
+
+    std::vector<Generator> generators;
+    generators.push_back({ "DefaultChunkGen", ChunkGen, ChunkBatchGen, ChunkGenFlags, ChunkGenOwner });
+    BlockManager blocks;
+    PluginManager plugins;
+    PluginAPI::Blocks = &blocks;
+    PluginAPI::Plugins = &plugins;
+    plugins.loadPlugins("./");
+    if (ChunkGeneratorLoaded)
+        generators.push_back({ "Plugin generator", ChunkGen, ChunkBatchGen, ChunkGenFlags, ChunkGenOwner });
+
+    infostream << "Generating " << chunks.size() << " chunks per run, " << BatchSize << " per call";
+    for (const Generator& generator : generators)
+    {
+        ChunkGen = generator.generator;
+        ChunkBatchGen = generator.batchGenerator;
+        ChunkGenFlags = generator.flags;
+        ChunkGenOwner = generator.owner;
+        // Generators with caches of their own are warm in the second run
+        Result single = run(chunks, nullptr);
+        report(generator.name, 1, chunks.size(), single);
+        Result multi = run(chunks, &pool);
+        report(generator.name, pool.getThreadCount(), chunks.size(), multi);
+        if (multi.checksum != single.checksum)
+            warningstream << generator.name << " is not deterministic across threads";
+    }
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "density.h"
+
+// SSE2 is part of the x86-64 baseline, no runtime dispatch needed
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define DENSITY_SSE2
+    #include <emmintrin.h>
+#endif
+
+namespace WorldGen
+{
+    double DensityScale = 32;
+    float DensityAmplitude = 32.0f;
+
+    double Noise3D(int x, int y, int z)
+    {
+        // Widened before multiplying, world coordinates overflow int
+        long long xx = (long long)x * 107 + y * 13258953287LL + (long long)z * 2750159;
+        xx = xx >> 13 ^ xx;
+        // The hash wraps around, which is only defined for unsigned integers
+        unsigned long long h = (unsigned long long)xx;
+        return ((h*(h*h * 15731 + 789221) + 1376312589) & 0x7fffffff) / 16777216.0;
+    }
+
+    double InterpolatedNoise3D(double x, double y, double z)
+    {
+        int intX = int(floor(x)), intY = int(floor(y)), intZ = int(floor(z));
+        double fx = x - intX, fy = y - intY, fz = z - intZ;
+        double v[2][2];
+        for (int dy = 0; dy < 2; dy++)
+            for (int dz = 0; dz < 2; dz++)
+                v[dy][dz] = Noise3D(intX, intY + dy, intZ + dz)*(1.0 - fx) + Noise3D(intX + 1, intY + dy, intZ + dz)*fx;
+        double i1 = v[0][0] * (1.0 - fy) + v[1][0] * fy;
+        double i2 = v[0][1] * (1.0 - fy) + v[1][1] * fy;
+        return i1*(1.0 - fz) + i2*fz;
+    }
+
+    double PerlinNoise3D(double x, double y, double z)
+    {
+        double total = 0, frequency = 1, amplitude = 1;
+        for (int i = 0; i <= 2; i++)
+        {
+            total += InterpolatedNoise3D(x*frequency, y*frequency, z*frequency)*amplitude;
+            frequency *= 2;
+            amplitude /= 2.0;
+        }
+        return total;
+    }
+
+    float getDensityNoise(int x, int y, int z)
+    {
+        // Noise3D is in [0, 128), the three octaves add up to 1.75 times that
+        constexpr double NoiseRange = 128.0 * 1.75;
+        double noise = PerlinNoise3D(x / DensityScale, y / DensityScale, z / DensityScale) / NoiseRange;
+        return float((noise - 0.5) * DensityAmplitude);
+    }
+
+    void getDensityLattice(const NWvec3i& pos, float* lattice)
+    {
+        for (int i = 0; i < DensityLatticeSize; i++)
+            for (int j = 0; j < DensityLatticeSize; j++)
+                for (int k = 0; k < DensityLatticeSize; k++)
+                    lattice[(i * DensityLatticeSize + j) * DensityLatticeSize + k] =
+                        getDensityNoise(pos.x * NoiseGridSize + i * DensityCellSize, pos.y * NoiseGridSize + j * DensityCellSize,
+                                        pos.z * NoiseGridSize + k * DensityCellSize);
+    }
+
+    namespace
+    {
+        static_assert(DensityCellSize == 4, "Cell rows are interpolated as 4-wide vectors");
+        static_assert(sizeof(NWblockdata) == sizeof(uint32_t), "Blocks are written as 32-bit words");
+
+        constexpr int ChunkSize = NoiseGridSize;
+        /// Tolerance of the bulk classification for the rounding of the interpolation
+        constexpr float BulkMargin = 1.0f / 64.0f;
+
+        /// Index of a lattice point
+        inline int latticeIndex(int i, int j, int k)
+        {
+            return (i * DensityLatticeSize + j) * DensityLatticeSize + k;
+        }
+
+        void fillCell(NWblockdata* cell, NWblockdata block)
+        {
+            for (int x = 0; x < DensityCellSize; x++)
+                for (int y = 0; y < DensityCellSize; y++)
+                    std::fill_n(cell + x * ChunkSize * ChunkSize + y * ChunkSize, DensityCellSize, block);
+        }
+
+        /// Interpolate a cell from its corners c[x][y][z]. heights are the surface heights plus one of the cell columns
+        /// (heights[x * DensityCellSize + z]) relative to the bottom of the cell.
+        void interpolateCell(const float c[2][2][2], const int* heights, uint32_t solid, uint32_t empty, NWblockdata* cell)
+        {
+#ifdef DENSITY_SSE2
+            const __m128 t = _mm_setr_ps(0.0f, 0.25f, 0.5f, 0.75f);
+            const __m128i solidBits = _mm_set1_epi32(int(solid)), emptyBits = _mm_set1_epi32(int(empty));
+#endif
+            for (int x = 0; x < DensityCellSize; x++)
+            {
+                const float fx = x * 0.25f;
+                const float a00 = c[0][0][0] + (c[1][0][0] - c[0][0][0])*fx, a10 = c[0][1][0] + (c[1][1][0] - c[0][1][0])*fx;
+                const float a01 = c[0][0][1] + (c[1][0][1] - c[0][0][1])*fx, a11 = c[0][1][1] + (c[1][1][1] - c[0][1][1])*fx;
+                const int* row = heights + x * DensityCellSize;
+#ifdef DENSITY_SSE2
+                const __m128i rowHeights = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row));
+#endif
+                for (int y = 0; y < DensityCellSize; y++)
+                {
+                    const float fy = y * 0.25f;
+                    const float b0 = a00 + (a10 - a00)*fy, b1 = a01 + (a11 - a01)*fy;
+                    NWblockdata* out = cell + x * ChunkSize * ChunkSize + y * ChunkSize;
+#ifdef DENSITY_SSE2
+                    __m128 noise = _mm_add_ps(_mm_set1_ps(b0), _mm_mul_ps(_mm_set1_ps(b1 - b0), t));
+                    __m128 density = _mm_add_ps(_mm_cvtepi32_ps(_mm_sub_epi32(rowHeights, _mm_set1_epi32(y))), noise);
+                    __m128i mask = _mm_castps_si128(_mm_cmpgt_ps(density, _mm_setzero_ps()));
+                    __m128i res = _mm_or_si128(_mm_and_si128(mask, solidBits), _mm_andnot_si128(mask, emptyBits));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), res);
+#else
+                    for (int z = 0; z < DensityCellSize; z++)
+                    {
+                        float density = float(row[z] - y) + (b0 + (b1 - b0)*(z * 0.25f));
+                        uint32_t word = density > 0.0f ? solid : empty;
+                        memcpy(out + z, &word, sizeof(word));
+                    }
+#endif
+                }
+            }
+        }
+    }
+
+    void generateDensityChunk(const NWvec3i& pos, const HeightmapColumn& column, NWblockdata solid, NWblockdata empty,
+                              NWblockdata* blocks)
+    {
+        const int bottom = pos.y * ChunkSize;
+        // The noise can't reach chunks far enough from the surface
+        if (bottom > column.maxHeight + 1 + DensityAmplitude / 2 ||
+            bottom + ChunkSize - 1 < column.minHeight + 1 - DensityAmplitude / 2)
+        {
+            std::fill_n(blocks, ChunkSize * ChunkSize * ChunkSize, bottom > column.maxHeight ? empty : solid);
+            return;
+        }
+
+        float lattice[DensityLatticeSize * DensityLatticeSize * DensityLatticeSize];
+        getDensityLattice(pos, lattice);
+        uint32_t solidBits, emptyBits;
+        memcpy(&solidBits, &solid, sizeof(solidBits));
+        memcpy(&emptyBits, &empty, sizeof(emptyBits));
+
+        for (int i = 0; i < DensityLatticeSize - 1; i++)
+            for (int k = 0; k < DensityLatticeSize - 1; k++)
+            {
+                const int x0 = i * DensityCellSize, z0 = k * DensityCellSize;
+                int heights[DensityCellSize * DensityCellSize];
+                // One above the surface, the surface block is solid without noise
+                int minHeight = column.heights[x0 * ChunkSize + z0] + 1 - bottom, maxHeight = minHeight;
+                for (int x = 0; x < DensityCellSize; x++)
+                    for (int z = 0; z < DensityCellSize; z++)
+                    {
+                        int height = column.heights[(x0 + x) * ChunkSize + z0 + z] + 1 - bottom;
+                        heights[x * DensityCellSize + z] = height;
+                        minHeight = std::min(minHeight, height);
+                        maxHeight = std::max(maxHeight, height);
+                    }
+
+                for (int j = 0; j < DensityLatticeSize - 1; j++)
+                {
+                    const int y0 = j * DensityCellSize;
+                    NWblockdata* cell = blocks + x0 * ChunkSize * ChunkSize + y0 * ChunkSize + z0;
+                    float c[2][2][2];
+                    float minNoise = lattice[latticeIndex(i, j, k)], maxNoise = minNoise;
+                    for (int dx = 0; dx < 2; dx++)
+                        for (int dy = 0; dy < 2; dy++)
+                            for (int dz = 0; dz < 2; dz++)
+                            {
+                                c[dx][dy][dz] = lattice[latticeIndex(i + dx, j + dy, k + dz)];
+                                minNoise = std::min(minNoise, c[dx][dy][dz]);
+                                maxNoise = std::max(maxNoise, c[dx][dy][dz]);
+                            }
+                    // Trilinear interpolation stays within the corners, so the cell may be decided as a whole
+                    if (float(minHeight - (y0 + DensityCellSize - 1)) + minNoise > BulkMargin) fillCell(cell, solid);
+                    else if (float(maxHeight - y0) + maxNoise < -BulkMargin) fillCell(cell, empty);
+                    else
+                    {
+                        int cellHeights[DensityCellSize * DensityCellSize];
+                        for (int n = 0; n < DensityCellSize * DensityCellSize; n++) cellHeights[n] = heights[n] - y0;
+                        interpolateCell(c, cellHeights, solidBits, emptyBits, cell);
+                    }
+                }
+            }
+    }
+
+    void generateDensityChunkNaive(const NWvec3i& pos, const HeightmapColumn& column, NWblockdata solid, NWblockdata empty,
+                                   NWblockdata* blocks)
+    {
+        const int bottom = pos.y * ChunkSize;
+        for (int x = 0; x < ChunkSize; x++)
+            for (int y = 0; y < ChunkSize; y++)
+                for (int z = 0; z < ChunkSize; z++)
+                {
+                    float density = float(column.heights[x * ChunkSize + z] + 1 - bottom - y) +
+                                    getDensityNoise(pos.x * ChunkSize + x, bottom + y, pos.z * ChunkSize + z);
+                    blocks[(x * ChunkSize + y) * ChunkSize + z] = density > 0.0f ? solid : empty;
+                }
+    }
+}
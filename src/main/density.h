@@ -0,0 +1,59 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DENSITY_H_
+#define DENSITY_H_
+
+#include "../../api/cpp/nwapi.h"
+#include "heightmapcache.h"
+
+// 3D density terrain: a block is solid where surfaceHeight + 1 - y + densityNoise > 0,
+// which carves caves and overhangs into the heightmap terrain. Without noise the surface block is solid,
+// as with the plain heightmap generator (y <= surfaceHeight).
+namespace WorldGen
+{
+    /// Distance between density lattice points (blocks)
+    constexpr int DensityCellSize = 4;
+    /// Lattice points per chunk axis, including the ones shared with the next chunk
+    constexpr int DensityLatticeSize = NoiseGridSize / DensityCellSize + 1;
+
+    extern double DensityScale;
+    /// The density noise is in [-DensityAmplitude / 2, DensityAmplitude / 2)
+    extern float DensityAmplitude;
+
+    double Noise3D(int x, int y, int z);
+    double InterpolatedNoise3D(double x, double y, double z);
+    double PerlinNoise3D(double x, double y, double z);
+    /// Density noise at a world position
+    float getDensityNoise(int x, int y, int z);
+
+    /// Sample the density noise of a chunk on the coarse lattice: lattice[(i * DensityLatticeSize + j) * DensityLatticeSize + k]
+    /// is the noise at (pos + (i, j, k) * DensityCellSize) in world coordinates
+    void getDensityLattice(const NWvec3i& pos, float* lattice);
+
+    /// Generate a chunk (blocks[x * NoiseGridSize * NoiseGridSize + y * NoiseGridSize + z]) from the lattice,
+    /// interpolating it trilinearly. Cells which are solid or empty as a whole are filled in bulk.
+    void generateDensityChunk(const NWvec3i& pos, const HeightmapColumn& column, NWblockdata solid, NWblockdata empty,
+                              NWblockdata* blocks);
+    /// Same as generateDensityChunk, evaluating the noise at every block. Reference for quality and benchmarks.
+    void generateDensityChunkNaive(const NWvec3i& pos, const HeightmapColumn& column, NWblockdata solid, NWblockdata empty,
+                                   NWblockdata* blocks);
+}
+
+#endif // !DENSITY_H_
@@ -18,7 +18,7 @@
 */
 
 #include "../../api/cpp/nwapi.h"
-#include <cmath>
+#include "density.h"
 
 NWplugindata* MainPlugin = nullptr;
 
@@ -36,84 +36,28 @@ extern "C"
     NWAPIEXPORT void NWAPICALL unload();
 }
 
-// Perlin Noise 2D, copied from old NEWorld
-namespace WorldGen
-{
-    int seed = 3404;
-    double NoiseScaleX = 64;
-    double NoiseScaleZ = 64;
-
-    inline double Noise(int x, int y)
-    {
-        long long xx = x * 107 + y * 13258953287;
-        xx = xx >> 13 ^ xx;
-        return (xx*(xx*xx * 15731 + 789221) + 1376312589 & 0x7fffffff) / 16777216.0;
-    }
-
-    inline double Interpolate(double a, double b, double x)
-    {
-        return a*(1.0 - x) + b*x;
-    }
-
-    double InterpolatedNoise(double x, double y)
-    {
-        int int_X, int_Y;
-        double fractional_X, fractional_Y, v1, v2, v3, v4, i1, i2;
-        int_X = int(floor(x));
-        fractional_X = x - int_X;
-        int_Y = int(floor(y));
-        fractional_Y = y - int_Y;
-        v1 = Noise(int_X, int_Y);
-        v2 = Noise(int_X + 1, int_Y);
-        v3 = Noise(int_X, int_Y + 1);
-        v4 = Noise(int_X + 1, int_Y + 1);
-        i1 = Interpolate(v1, v2, fractional_X);
-        i2 = Interpolate(v3, v4, fractional_X);
-        return Interpolate(i1, i2, fractional_Y);
-    }
-
-    double PerlinNoise2D(double x, double y)
-    {
-        double total = 0, frequency = 1, amplitude = 1;
-        for (int i = 0; i <= 4; i++)
-        {
-            total += InterpolatedNoise(x*frequency, y*frequency)*amplitude;
-            frequency *= 2;
-            amplitude /= 2.0;
-        }
-        return total;
-    }
-
-    inline int getHeight(int x, int y)
-    {
-        return int(PerlinNoise2D(x / NoiseScaleX, y / NoiseScaleZ)) / 2 - 64;
-    }
-}
+// Heightmaps shared by the chunks of a column
+HeightmapCache Heightmaps;
 
 // Chunk generator
 void NWAPICALL generator(const NWvec3i* pos, NWblockdata* blocks, int daylightBrightness)
 {
-    for (int x = 0; x < ChunkSize; x++)
-        for (int z = 0; z < ChunkSize; z++)
-        {
-            int height = WorldGen::getHeight(x, z);
-            for (int y = 0; y < ChunkSize; y++)
-            {
-                NWblockdata &block = blocks[x*ChunkSize*ChunkSize + y*ChunkSize + z];
-                if (y <= height)
-                {
-                    block.id = RockID;
-                    block.brightness = block.state = 0;
-                }
-                else
-                {
-                    block.id = AirID;
-                    block.brightness = daylightBrightness;
-                    block.state = 0;
-                }
-            }
-        }
+    static_assert(ChunkSize == WorldGen::NoiseGridSize, "A noise grid should cover a chunk");
+    std::shared_ptr<const HeightmapColumn> column = Heightmaps.get(pos->x, pos->z);
+    // All air starts lit by daylight, caves included
+    NWblockdata rock, air;
+    rock.id = RockID;
+    rock.brightness = rock.state = 0;
+    air.id = AirID;
+    air.brightness = daylightBrightness;
+    air.state = 0;
+    WorldGen::generateDensityChunk(*pos, *column, rock, air, blocks);
+}
 
+// Batched chunk generator, one call across the plugin boundary for many chunks
+void NWAPICALL batchGenerator(const NWvec3i* pos, NWblockdata* const* blocks, int32_t count, int32_t daylightBrightness)
+{
+    for (int32_t i = 0; i < count; i++) generator(pos + i, blocks[i], daylightBrightness);
 }
 
 // Main function
@@ -127,7 +71,8 @@ NWplugindata* NWAPICALL init()
     rock.explodePower = 0;
     rock.hardness = 2;
     RockID = nwRegisterBlock(&rock);
-    nwRegisterChunkGenerator(generator);
+    // All generator state (heightmap cache, noise buffers) is thread-safe
+    nwRegisterChunkGeneratorEx(generator, batchGenerator, NW_CHUNKGEN_REENTRANT);
     MainPlugin = new NWplugindata();
     MainPlugin->pluginName = "NEWorld";
     MainPlugin->authorName = "INFINIDEAS";
@@ -0,0 +1,88 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "heightmapcache.h"
+
+using WorldGen::NoiseGridSize;
+
+std::shared_ptr<const HeightmapColumn> HeightmapCache::get(int x, int z)
+{
+    ColumnPos pos(x, z);
+    std::promise<std::shared_ptr<const HeightmapColumn>> promise;
+    Result cached;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto iter = m_columns.find(pos);
+        if (iter != m_columns.end())
+        {
+            m_lru.splice(m_lru.begin(), m_lru, iter->second);
+            cached = iter->second->second;
+            m_hits++;
+        }
+        else
+        {
+            m_lru.emplace_front(pos, promise.get_future().share());
+            m_columns.emplace(pos, m_lru.begin());
+            m_misses++;
+            shrink();
+        }
+    }
+    // Wait outside the lock if another thread is still computing the column
+    if (cached.valid()) return cached.get();
+
+    std::shared_ptr<HeightmapColumn> column = std::make_shared<HeightmapColumn>();
+    WorldGen::getHeightGrid(x * NoiseGridSize, z * NoiseGridSize, column->heights);
+    const int* heights = column->heights;
+    column->minHeight = *std::min_element(heights, heights + NoiseGridSize * NoiseGridSize);
+    column->maxHeight = *std::max_element(heights, heights + NoiseGridSize * NoiseGridSize);
+    promise.set_value(column);
+    return column;
+}
+
+int HeightmapCache::getSurfaceHeight(int x, int z)
+{
+    // Floor division, columns are NoiseGridSize wide
+    int cx = x >= 0 ? x / NoiseGridSize : (x - NoiseGridSize + 1) / NoiseGridSize;
+    int cz = z >= 0 ? z / NoiseGridSize : (z - NoiseGridSize + 1) / NoiseGridSize;
+    return get(cx, cz)->heights[(x - cx * NoiseGridSize) * NoiseGridSize + (z - cz * NoiseGridSize)];
+}
+
+void HeightmapCache::setCapacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capacity = capacity;
+    shrink();
+}
+
+size_t HeightmapCache::getColumnCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_columns.size();
+}
+
+void HeightmapCache::shrink()
+{
+    // Threads waiting for a dropped column keep their own reference to its result
+    while (m_columns.size() > m_capacity)
+    {
+        m_columns.erase(m_lru.back().first);
+        m_lru.pop_back();
+    }
+}
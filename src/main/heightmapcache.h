@@ -0,0 +1,105 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HEIGHTMAPCACHE_H_
+#define HEIGHTMAPCACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include "noise.h"
+
+/// Default number of chunk columns kept by the heightmap cache (4 KiB each)
+constexpr size_t DefaultHeightmapCacheCapacity = 1024;
+
+/// Terrain surface of a chunk column
+struct HeightmapColumn
+{
+    /// Height of the topmost solid block, heights[x * NoiseGridSize + z] (local coordinates)
+    int heights[WorldGen::NoiseGridSize * WorldGen::NoiseGridSize];
+    /// Lowest and highest surface in the column
+    int minHeight, maxHeight;
+};
+
+/// Thread-safe LRU cache of heightmaps by chunk column (x, z), so that all chunks of a column,
+/// lighting and spawn search share one noise pass. Concurrent misses of the same column wait for
+/// the thread which computes it instead of computing it again.
+class HeightmapCache
+{
+public:
+    explicit HeightmapCache(size_t capacity = DefaultHeightmapCacheCapacity)
+        : m_capacity(capacity), m_hits(0), m_misses(0)
+    {
+    }
+
+    HeightmapCache(const HeightmapCache&) = delete;
+    HeightmapCache& operator=(const HeightmapCache&) = delete;
+
+    /// Get the heightmap of a chunk column, computing it if necessary
+    std::shared_ptr<const HeightmapColumn> get(int x, int z);
+    /// Get the surface height at a world position
+    int getSurfaceHeight(int x, int z);
+
+    /// Set the number of columns to keep, dropping columns if necessary
+    void setCapacity(size_t capacity);
+
+    /// Get the number of columns to keep
+    size_t getCapacity() const
+    {
+        return m_capacity;
+    }
+
+    /// Get the number of cached columns
+    size_t getColumnCount() const;
+
+    /// Get the number of get() calls which found the column
+    uint64_t getHits() const
+    {
+        return m_hits;
+    }
+
+    /// Get the number of get() calls which computed the column
+    uint64_t getMisses() const
+    {
+        return m_misses;
+    }
+
+private:
+    using ColumnPos = std::pair<int, int>;
+    using Result = std::shared_future<std::shared_ptr<const HeightmapColumn>>;
+    using Entry = std::pair<ColumnPos, Result>;
+
+    size_t m_capacity;
+    /// Cached columns, most recently used first
+    std::list<Entry> m_lru;
+    /// Position to cached column
+    std::map<ColumnPos, std::list<Entry>::iterator> m_columns;
+    mutable std::mutex m_mutex;
+    std::atomic<uint64_t> m_hits, m_misses;
+
+    /// Drop least recently used columns until the capacity is met
+    void shrink();
+};
+
+#endif // !HEIGHTMAPCACHE_H_
@@ -0,0 +1,258 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "noise.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #define NOISE_X86
+    #define NOISE_TARGET(isa)
+    #include <intrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define NOISE_X86
+    // Only the kernels are compiled for the extension, FMA is left out on purpose: contracting
+    // a * b + c would break bit-exactness with the scalar implementation
+    #define NOISE_TARGET(isa) __attribute__((target(isa)))
+    #include <immintrin.h>
+#endif
+
+namespace WorldGen
+{
+    int seed = 3404;
+    double NoiseScaleX = 64;
+    double NoiseScaleZ = 64;
+
+    double Noise(int x, int y)
+    {
+        long long xx = x * 107 + y * 13258953287;
+        xx = xx >> 13 ^ xx;
+        return (xx*(xx*xx * 15731 + 789221) + 1376312589 & 0x7fffffff) / 16777216.0;
+    }
+
+    inline double Interpolate(double a, double b, double x)
+    {
+        return a*(1.0 - x) + b*x;
+    }
+
+    double InterpolatedNoise(double x, double y)
+    {
+        int int_X, int_Y;
+        double fractional_X, fractional_Y, v1, v2, v3, v4, i1, i2;
+        int_X = int(floor(x));
+        fractional_X = x - int_X;
+        int_Y = int(floor(y));
+        fractional_Y = y - int_Y;
+        v1 = Noise(int_X, int_Y);
+        v2 = Noise(int_X + 1, int_Y);
+        v3 = Noise(int_X, int_Y + 1);
+        v4 = Noise(int_X + 1, int_Y + 1);
+        i1 = Interpolate(v1, v2, fractional_X);
+        i2 = Interpolate(v3, v4, fractional_X);
+        return Interpolate(i1, i2, fractional_Y);
+    }
+
+    double PerlinNoise2D(double x, double y)
+    {
+        double total = 0, frequency = 1, amplitude = 1;
+        for (int i = 0; i <= 4; i++)
+        {
+            total += InterpolatedNoise(x*frequency, y*frequency)*amplitude;
+            frequency *= 2;
+            amplitude /= 2.0;
+        }
+        return total;
+    }
+
+    int getHeight(int x, int y)
+    {
+        return int(PerlinNoise2D(x / NoiseScaleX, y / NoiseScaleZ)) / 2 - 64;
+    }
+
+    namespace
+    {
+        constexpr int Octaves = 5;
+
+        // total[j] += Interpolate(Interpolate(v1, v2, fx), Interpolate(v3, v4, fx), fy[j]) * amplitude
+        // for a row of NoiseGridSize columns, with the operations in the same order as InterpolatedNoise
+        using CombineRow = void(*)(const double* v1, const double* v2, const double* v3, const double* v4,
+                                   double fx, const double* fy, double amplitude, double* total);
+
+        void combineRowScalar(const double* v1, const double* v2, const double* v3, const double* v4,
+                              double fx, const double* fy, double amplitude, double* total)
+        {
+            for (int j = 0; j < NoiseGridSize; j++)
+            {
+                double i1 = Interpolate(v1[j], v2[j], fx);
+                double i2 = Interpolate(v3[j], v4[j], fx);
+                total[j] += Interpolate(i1, i2, fy[j])*amplitude;
+            }
+        }
+
+#ifdef NOISE_X86
+        NOISE_TARGET("sse2")
+        void combineRowSSE2(const double* v1, const double* v2, const double* v3, const double* v4,
+                            double fx, const double* fy, double amplitude, double* total)
+        {
+            const __m128d one = _mm_set1_pd(1.0), x = _mm_set1_pd(fx), rx = _mm_set1_pd(1.0 - fx);
+            const __m128d amp = _mm_set1_pd(amplitude);
+            for (int j = 0; j < NoiseGridSize; j += 2)
+            {
+                __m128d i1 = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(v1 + j), rx), _mm_mul_pd(_mm_loadu_pd(v2 + j), x));
+                __m128d i2 = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(v3 + j), rx), _mm_mul_pd(_mm_loadu_pd(v4 + j), x));
+                __m128d y = _mm_loadu_pd(fy + j);
+                __m128d res = _mm_add_pd(_mm_mul_pd(i1, _mm_sub_pd(one, y)), _mm_mul_pd(i2, y));
+                _mm_storeu_pd(total + j, _mm_add_pd(_mm_loadu_pd(total + j), _mm_mul_pd(res, amp)));
+            }
+        }
+
+        NOISE_TARGET("avx2")
+        void combineRowAVX2(const double* v1, const double* v2, const double* v3, const double* v4,
+                            double fx, const double* fy, double amplitude, double* total)
+        {
+            const __m256d one = _mm256_set1_pd(1.0), x = _mm256_set1_pd(fx), rx = _mm256_set1_pd(1.0 - fx);
+            const __m256d amp = _mm256_set1_pd(amplitude);
+            for (int j = 0; j < NoiseGridSize; j += 4)
+            {
+                __m256d i1 = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(v1 + j), rx), _mm256_mul_pd(_mm256_loadu_pd(v2 + j), x));
+                __m256d i2 = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(v3 + j), rx), _mm256_mul_pd(_mm256_loadu_pd(v4 + j), x));
+                __m256d y = _mm256_loadu_pd(fy + j);
+                __m256d res = _mm256_add_pd(_mm256_mul_pd(i1, _mm256_sub_pd(one, y)), _mm256_mul_pd(i2, y));
+                _mm256_storeu_pd(total + j, _mm256_add_pd(_mm256_loadu_pd(total + j), _mm256_mul_pd(res, amp)));
+            }
+        }
+
+        bool hasAVX2()
+        {
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7) return false;
+            __cpuid(info, 1);
+            // AVX and OSXSAVE, and the OS saves the YMM registers
+            if ((info[2] & (1 << 28)) == 0 || (info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6) return false;
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+
+        bool hasSSE2()
+        {
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 1);
+            return (info[3] & (1 << 26)) != 0;
+#else
+            return __builtin_cpu_supports("sse2");
+#endif
+        }
+#endif
+
+        struct Kernel
+        {
+            CombineRow combineRow;
+            const char* name;
+        };
+
+        Kernel selectKernel()
+        {
+#ifdef NOISE_X86
+            if (hasAVX2()) return{ combineRowAVX2, "avx2" };
+            if (hasSSE2()) return{ combineRowSSE2, "sse2" };
+#endif
+            return{ combineRowScalar, "scalar" };
+        }
+
+        const Kernel& getKernel()
+        {
+            static const Kernel kernel = selectKernel();
+            return kernel;
+        }
+
+        // Integer and fractional parts of lattice coordinates of a row of columns
+        void getLatticeCoords(int begin, double scale, double frequency, int* ints, double* fractions)
+        {
+            for (int i = 0; i < NoiseGridSize; i++)
+            {
+                double coord = (begin + i) / scale*frequency;
+                ints[i] = int(floor(coord));
+                fractions[i] = coord - ints[i];
+            }
+        }
+    }
+
+    void PerlinNoise2DGrid(int x, int y, double* out)
+    {
+        CombineRow combineRow = getKernel().combineRow;
+        int intX[NoiseGridSize], intY[NoiseGridSize];
+        double fracX[NoiseGridSize], fracY[NoiseGridSize];
+        // Noise at lattice points, expanded along y: lower[a][j] = Noise(minX + a, intY[j]), upper[..] at intY[j] + 1
+        thread_local std::vector<double> lower, upper;
+
+        std::fill_n(out, NoiseGridSize * NoiseGridSize, 0.0);
+        double frequency = 1, amplitude = 1;
+        for (int octave = 0; octave < Octaves; octave++)
+        {
+            getLatticeCoords(x, NoiseScaleX, frequency, intX, fracX);
+            getLatticeCoords(y, NoiseScaleZ, frequency, intY, fracY);
+
+            // Columns of a grid share few lattice points, so each is hashed once instead of four times per column
+            const int minX = *std::min_element(intX, intX + NoiseGridSize);
+            const int rows = *std::max_element(intX, intX + NoiseGridSize) - minX + 2;
+            lower.resize(size_t(rows) * NoiseGridSize);
+            upper.resize(size_t(rows) * NoiseGridSize);
+            for (int a = 0; a < rows; a++)
+                for (int j = 0; j < NoiseGridSize; j++)
+                {
+                    if (j > 0 && intY[j] == intY[j - 1])
+                    {
+                        lower[a * NoiseGridSize + j] = lower[a * NoiseGridSize + j - 1];
+                        upper[a * NoiseGridSize + j] = upper[a * NoiseGridSize + j - 1];
+                        continue;
+                    }
+                    lower[a * NoiseGridSize + j] = Noise(minX + a, intY[j]);
+                    upper[a * NoiseGridSize + j] = Noise(minX + a, intY[j] + 1);
+                }
+
+            for (int i = 0; i < NoiseGridSize; i++)
+            {
+                const size_t row = size_t(intX[i] - minX) * NoiseGridSize;
+                combineRow(&lower[row], &lower[row + NoiseGridSize], &upper[row], &upper[row + NoiseGridSize],
+                           fracX[i], fracY, amplitude, out + i * NoiseGridSize);
+            }
+            frequency *= 2;
+            amplitude /= 2.0;
+        }
+    }
+
+    void getHeightGrid(int x, int y, int* heights)
+    {
+        double noise[NoiseGridSize * NoiseGridSize];
+        PerlinNoise2DGrid(x, y, noise);
+        for (int i = 0; i < NoiseGridSize * NoiseGridSize; i++) heights[i] = int(noise[i]) / 2 - 64;
+    }
+
+    const char* getNoiseInstructionSet()
+    {
+        return getKernel().name;
+    }
+}
@@ -0,0 +1,48 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NOISE_H_
+#define NOISE_H_
+
+// Perlin Noise 2D, copied from old NEWorld
+namespace WorldGen
+{
+    constexpr int NoiseGridSize = 32;
+
+    extern int seed;
+    extern double NoiseScaleX;
+    extern double NoiseScaleZ;
+
+    // Scalar reference implementation, one column per call
+    double Noise(int x, int y);
+    double InterpolatedNoise(double x, double y);
+    double PerlinNoise2D(double x, double y);
+    int getHeight(int x, int y);
+
+    // Batch implementation, bit-exact with the scalar one:
+    // out[i * NoiseGridSize + j] = PerlinNoise2D((x + i) / NoiseScaleX, (y + j) / NoiseScaleZ)
+    void PerlinNoise2DGrid(int x, int y, double* out);
+    // heights[i * NoiseGridSize + j] = getHeight(x + i, y + j)
+    void getHeightGrid(int x, int y, int* heights);
+
+    // SIMD instruction set used by the batch implementation ("avx2", "sse2" or "scalar")
+    const char* getNoiseInstructionSet();
+}
+
+#endif // !NOISE_H_
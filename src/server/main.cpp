@@ -29,6 +29,7 @@ extern "C" NWAPIEXPORT int NWAPICALL main(int, char**);
 
 int NWAPICALL main(int argc, char** argv)
 {
+    serverStartTime = std::chrono::steady_clock::now();
     loadSettings();
     Logger::init("server");
     infostream << "\n----------------------------------------"
@@ -36,10 +37,12 @@ int NWAPICALL main(int argc, char** argv)
                << "----------------------------------------";
     infostream << "NEWorld Server v" << NEWorldVersion << ", Release Version:" << ReleaseVersion << ", compiled at " << __TIME__ << " " << __DATE__;
     infostream << "Server starting...";
-    std::thread inputThread(inputThreadFunc);
+    std::thread inputThread;
     try
     {
         Server s(ioService, globalPort, /*(argc == 3) ? argv[2] : */"./");
+        // Commands need the server, start the console after it is up
+        inputThread = std::thread(inputThreadFunc, std::ref(s));
         ioService.run();
     }
     catch (std::exception& e)
@@ -48,7 +51,7 @@ int NWAPICALL main(int argc, char** argv)
         stopInputThreadRunning();
     }
     infostream << "Server is stopping...";
-    inputThread.join();
+    if (inputThread.joinable()) inputThread.join();
     saveSettings();
     return 0;
 }
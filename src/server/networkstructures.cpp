@@ -20,25 +20,35 @@
 #include "../shared/common.h"
 #include "networkstructures.h"
 #include <logger.h>
+#include <atomic>
+#include "server.h"
 
-#define DEFAULT_IMPLEMENT(classname) void LoginPacket::process() { assert(false); }
+#define DEFAULT_IMPLEMENT(classname) bool classname::process() const { assert(false); return false; }
 
 //Define the ways the data packets process.
 
-void ChatPacket::process()
+bool ChatPacket::process() const
 {
     //Do something like sending it to all players.
+    return true;
 }
 
-void LoginPacket::process()
+bool LoginPacket::process() const
 {
     if (true) //TODO: password verifies
     {
         infostream << "Player " << m_username << " login!"; //TODO: Fix it: extra space
+        static std::atomic<bool> firstLogin(true);
+        if (firstLogin.exchange(false))
+            infostream << "First login accepted "
+                       << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - serverStartTime).count()
+                       << "ms after the server started";
+        return true;
     }
     else
     {
         infostream << "Player " << m_username << " failed to login. Wrong password.";
+        return false;
     }
 }
 
@@ -23,6 +23,7 @@ using namespace boost::asio;
 using namespace boost::system;
 
 unsigned short globalPort;
+std::chrono::steady_clock::time_point serverStartTime = std::chrono::steady_clock::now();
 
 void errorHandle(const tcp::socket& m_socket, error_code ec)
 {
@@ -31,33 +32,13 @@ void errorHandle(const tcp::socket& m_socket, error_code ec)
 
 void Session::doUpdate()
 {
-    return;
-    auto self(shared_from_this());
-    deadline_timer(m_socket.get_io_service(), boost::posix_time::microseconds(updateInterval)).async_wait(
-        [this, self](error_code)
-    {
-        // TODO: Process client actions here
-        doWrite();
-    });
+    // TODO: Process client actions here
 }
 
-//void Server::sendToAllSessions(Packet packet)
-//{
-//TODO: fix it
-//for (auto iter = m_sessions.begin(); iter != m_sessions.end();)
-//{
-//    auto session = iter->lock();
-//    if (session)
-//    {
-//        session->addRequest(packet);
-//        ++iter;
-//    }
-//    else
-//    {
-//        iter = m_sessions.erase(iter);
-//    }
-//}
-//}
+void Server::sendToAllSessions(const Packet& packet)
+{
+    ::sendToAllSessions(m_sessions, packet);
+}
 
 void Server::doAccept()
 {
@@ -66,7 +47,8 @@ void Server::doAccept()
         if (!ec)
         {
             infostream << m_socket.remote_endpoint().address().to_string() << " connected to the server";
-            auto session = std::make_shared<Session>(std::move(m_socket));
+            // Clients can't make the server buffer large packets before they log in
+            auto session = std::make_shared<Session>(std::move(m_socket), MaxLoginPacketLength);
             session->start();
             m_sessions.push_back(session);
         }
@@ -76,12 +58,17 @@ void Server::doAccept()
 
 void Server::doGlobalUpdate()
 {
-    return;
-    boost::asio::deadline_timer(m_socket.get_io_service(), boost::posix_time::microseconds(globalUpdateInterval)).async_wait(
-        [this](boost::system::error_code)
+    m_updateTimer.async_wait([this](error_code ec)
     {
+        if (ec) return; // Cancelled, the server is stopping
         // Update worlds
         for (auto world : m_worlds) world->update();
+        m_plugins.getEvents().tick();
+        m_plugins.getTasks().tick();
+        // Fixed rate, unless an update took so long that the next ones are already due
+        auto next = m_updateTimer.expires_at() + boost::posix_time::milliseconds(globalUpdateInterval);
+        auto now = deadline_timer::traits_type::now();
+        m_updateTimer.expires_at(next > now ? next : now);
         doGlobalUpdate();
     });
 }
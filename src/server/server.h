@@ -20,6 +20,7 @@
 #ifndef SERVER_H_
 #define SERVER_H_
 
+#include <chrono>
 #include <memory>
 #include <vector>
 #include <networkshared.h>
@@ -29,24 +30,40 @@
 #include <blockmanager.h>
 #include <pluginmanager.h>
 #include <pluginapi.h>
+#include <threadpool.h>
 
-constexpr int updateInterval = 10, globalUpdateInterval = 10;
+// Interval of world updates, plugin events and plugin tasks (milliseconds)
+constexpr int globalUpdateInterval = 10;
 
 extern unsigned short globalPort;
+// When the server process started, for startup timing
+extern std::chrono::steady_clock::time_point serverStartTime;
 
 class Server
 {
 public:
     Server(boost::asio::io_service& ioservice, unsigned short port, const std::string& base)
         : m_acceptor(ioservice, boost::asio::ip::tcp::endpoint(tcp::v4(), port)), m_socket(ioservice),
-          m_worlds(m_plugins, m_blocks)
+          m_updateTimer(ioservice), m_worlds(m_plugins, m_blocks, "./worlds/")
     {
         // Initialization
         PluginAPI::Blocks = &m_blocks;
+        PluginAPI::Plugins = &m_plugins;
+        // Before the plugins load, init() may schedule jobs
+        m_plugins.getTasks().setThreadPool(&m_threadPool);
         infostream << "Initializing plugins...";
         m_plugins.loadPlugins(base);
+        // Load worlds
+        m_world = m_worlds.addWorld("main");
+        PluginAPI::CurrWorld = m_world;
+        auto snapshotBegin = std::chrono::steady_clock::now();
+        int snapshotChunks = m_world->loadSnapshot();
+        infostream << "Loaded " << snapshotChunks << " spawn chunks from the world snapshot in "
+                   << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - snapshotBegin).count() << "ms";
         // Start server
-        infostream << "Server started!";
+        infostream << "Server started in "
+                   << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - serverStartTime).count() << "ms!";
+        m_updateTimer.expires_from_now(boost::posix_time::milliseconds(globalUpdateInterval));
         doGlobalUpdate();
         doAccept();
     }
@@ -54,9 +71,37 @@ public:
     ~Server()
     {
         // TODO: Terminate here
+        // The thread pool goes first, plugins must not schedule on it anymore
+        m_plugins.getTasks().setThreadPool(nullptr);
     }
 
-    //void sendToAllSessions(Packet packet);
+    // Queue a packet on every connected session. The sessions share the encoded data, it is not copied.
+    void sendToAllSessions(const Packet& packet);
+
+    // Encode a network structure once and queue it on every connected session
+    template <typename Structure>
+    void broadcast(const Structure& structure)
+    {
+        sendToAllSessions(structure.makePacket());
+    }
+
+    // Get the default world
+    World& getWorld()
+    {
+        return *m_world;
+    }
+
+    // Get loaded plugins
+    PluginManager& getPlugins()
+    {
+        return m_plugins;
+    }
+
+    // Get the worker threads for background jobs
+    ThreadPool& getThreadPool()
+    {
+        return m_threadPool;
+    }
 
 private:
     void doAccept();
@@ -65,10 +110,13 @@ private:
     tcp::acceptor m_acceptor;
     tcp::socket m_socket;
     std::vector<std::weak_ptr<Session>> m_sessions;
+    boost::asio::deadline_timer m_updateTimer; // Drives doGlobalUpdate()
 
     WorldManager m_worlds;
     BlockManager m_blocks;
     PluginManager m_plugins; // Loaded plugins
+    World* m_world; // Default world
+    ThreadPool m_threadPool; // Destroyed first, jobs may use the worlds
 };
 
 #endif // SERVER_H__
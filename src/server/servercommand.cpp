@@ -21,16 +21,20 @@
 #include <logger.h>
 #include <consolecolor.h>
 #include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
 #include <command.h>
 #include "server.h"
 #include <utils.h>
 #include "settings.h"
+#include "worldpregen.h"
 #include <type.h>
 
 bool inputThreadRunning = true;
 
 CommandMap commandMap;
-#define CommandDefine(commandName, commandAuthor, commandHelp) commandMap.insert({commandName, std::pair<CommandInfo,CommandHandleFunction>({commandAuthor, commandHelp},[](Command cmd)->CommandExecuteStat
+#define CommandDefine(commandName, commandAuthor, commandHelp) commandMap.insert({commandName, std::pair<CommandInfo,CommandHandleFunction>({commandAuthor, commandHelp},[&](Command cmd)->CommandExecuteStat
 #define EndCommandDefine )})
 
 void stopInputThreadRunning()
@@ -38,7 +42,7 @@ void stopInputThreadRunning()
     inputThreadRunning = false;
 }
 
-void initCommands()
+void initCommands(Server& server)
 {
     CommandDefine("help", "Internel", "Help")
     {
@@ -111,6 +115,34 @@ void initCommands()
     }
     EndCommandDefine;
 
+    CommandDefine("world.pregen", "Internal", "Generate and save chunks around the spawn on all cores, resumable. Usage: world.pregen <radius>")
+    {
+        const std::string usage = "Usage: world.pregen <radius>, radius 1 to " + std::to_string(PregenMaxRadius);
+        if (cmd.args.size() != 1) return{ false, usage };
+        char* end;
+        long radius = std::strtol(cmd.args[0].c_str(), &end, 10);
+        if (cmd.args[0].empty() || *end != '\0' || radius <= 0 || radius > PregenMaxRadius) return{ false, usage };
+        if (server.getWorld().getStorage() == nullptr) return{ false, "The world is not saved" };
+        size_t generated = pregenerateWorld(server.getWorld(), server.getThreadPool(), Vec3i(0, 0, 0), int(radius));
+        return{ true, "Generated " + std::to_string(generated) + " chunks" };
+    }
+    EndCommandDefine;
+
+    CommandDefine("plugins.stats", "Internal", "Show the time spent in each plugin.")
+    {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(3);
+        for (const auto& stats : server.getPlugins().getStats())
+        {
+            uint64_t calls = stats->calls, nanoseconds = stats->nanoseconds;
+            ss << '\n' << stats->name << ": " << calls << " calls, " << nanoseconds / 1e6 << "ms in total, "
+               << (calls != 0 ? nanoseconds / 1e3 / calls : 0.0) << "us per call, " << stats->maxNanoseconds / 1e6
+               << "ms at most, " << stats->slowCalls << " slow calls";
+        }
+        return{ true, ss.str() };
+    }
+    EndCommandDefine;
+
     CommandDefine("conf.set", "Internal", "Set one configuration item. Usage: conf.set <confname> <value>")
     {
         if (cmd.args.size() == 2)
@@ -170,9 +202,9 @@ CommandExecuteStat handleCommand(Command cmd)
         return{ false,"Failed to execute the command: The command does not exist, type help for available commands." };
 }
 
-void inputThreadFunc()
+void inputThreadFunc(Server& server)
 {
-    initCommands();
+    initCommands(server);
     while (inputThreadRunning)
     {
         std::string input;
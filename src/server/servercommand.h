@@ -19,7 +19,9 @@
 #ifndef SERVERCOMMAND_H_
 #define SERVERCOMMAND_H_
 
-void inputThreadFunc();
+class Server;
+
+void inputThreadFunc(Server& server);
 
 void stopInputThreadRunning();
 
@@ -38,8 +38,8 @@ void WorldLoader::sortChunkLoadUnloadList(const Vec3i& centerPos)
             x = x * ChunkSize + ChunkSize / 2 - 1;
         });
 
-        // Out of load range, pending to unload
-        if (centerPos.chebyshevDistance(curPos) > m_loadRange)
+        // Out of unload range, pending to unload
+        if (centerPos.chebyshevDistance(curPos) > m_loadRange + m_unloadHysteresis)
         {
             // Distance from centerPos
             distsqr = (curPos - centerPos).lengthSqr();
@@ -116,18 +116,36 @@ void WorldLoader::sortChunkLoadUnloadList(const Vec3i& centerPos)
                     if (pu < MaxChunkLoadCount) pu++;
                 }
     m_chunkLoadCount = pu;
+
+    // Read ahead saved chunks in the load list, they will be loaded soon
+    if (WorldStorage* storage = m_world.getStorage())
+        for (int i = 0; i < m_chunkLoadCount; i++) storage->prefetch(m_chunkLoadList[i].first);
 }
 
 void WorldLoader::loadUnloadChunks() const
 {
+    // Worlds which are only kept in memory are generated again
+    WorldStorage* storage = m_world.getStorage();
     for (int i = 0; i < m_chunkLoadCount; i++)
     {
-        // TODO: Try to read in file
-        ChunkLoader(*m_world.addChunk(m_chunkLoadList[i].first)).build(m_world.getDaylightBrightness());
+        Chunk& chunk = *m_world.addChunk(m_chunkLoadList[i].first);
+        if (m_world.getChunkCache().take(chunk)) continue;
+        if (storage == nullptr || !storage->loadChunk(chunk))
+        {
+            ChunkLoader(chunk).build(m_world.getDaylightBrightness());
+            // Edits of this chunk may have been replayed before it was ever saved
+            if (storage != nullptr) m_world.getJournal()->applyOrphans(chunk);
+        }
     }
     for (int i = 0; i < m_chunkUnloadCount; i++)
     {
-        // TODO: Save chunk
-        m_world.deleteChunk(m_chunkUnloadList[i].first->getPosition());
+        Chunk& chunk = *m_chunkUnloadList[i].first;
+        if (storage != nullptr)
+        {
+            if (chunk.isDirty()) storage->saveChunk(chunk);
+            // The cache only keeps saved chunks
+            m_world.getChunkCache().put(chunk);
+        }
+        m_world.deleteChunk(chunk.getPosition());
     }
 }
@@ -25,6 +25,7 @@
 #include <chunkpointerarray.h>
 
 constexpr int MaxChunkLoadCount = 64, MaxChunkUnloadCount = 64;
+constexpr int DefaultUnloadHysteresis = ChunkSize * 2;
 
 class WorldLoader
 {
@@ -35,6 +36,8 @@ private:
     ChunkPointerArray& m_cpa;
 
     int m_chunkLoadCount, m_chunkUnloadCount, m_loadRange;
+    /// Extra distance a chunk must be out of load range before it is unloaded
+    int m_unloadHysteresis;
     /// Chunk load list [position, distance]
     std::pair<Vec3i, int> m_chunkLoadList[MaxChunkLoadCount];
     /// Chunk unload list [pointer, distance]
@@ -42,7 +45,8 @@ private:
 
 public:
     WorldLoader(World& world, ChunkPointerArray& cpa)
-        : m_world(world), m_cpa(cpa), m_chunkLoadCount(0), m_chunkUnloadCount(0), m_loadRange(0)
+        : m_world(world), m_cpa(cpa), m_chunkLoadCount(0), m_chunkUnloadCount(0), m_loadRange(0),
+          m_unloadHysteresis(DefaultUnloadHysteresis)
     {
     }
 
@@ -52,6 +56,13 @@ public:
         m_loadRange = x;
     }
 
+    /// Set the extra distance beyond load range before chunks are unloaded,
+    /// so that walking along the boundary doesn't unload and reload the same chunks
+    void setUnloadHysteresis(int x)
+    {
+        m_unloadHysteresis = x;
+    }
+
     /// Find the nearest chunks in load range to load, fartherest chunks out of load range to unload
     void sortChunkLoadUnloadList(const Vec3i& centerPos);
     /// Load & unload chunks
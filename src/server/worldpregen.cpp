@@ -0,0 +1,141 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+#include <logger.h>
+#include "worldpregen.h"
+
+// Chunks the save queue may hold before generation waits for it, bounds the memory of snapshots
+constexpr size_t PregenMaxQueuedChunks = 1024;
+// Chunks sent through the generation pipeline at once
+constexpr size_t PregenBatchSize = 256;
+
+namespace
+{
+    // Walks the cube [-radius, radius]^3 one Chebyshev shell at a time, nearest shell first, without storing it
+    class ShellWalker
+    {
+    public:
+        explicit ShellWalker(int radius) : m_radius(radius), m_shell(0), m_pos(0, 0, 0)
+        {
+        }
+
+        // Get the next position, return false when the cube is done
+        bool next(Vec3i& pos)
+        {
+            if (m_shell > m_radius) return false;
+            pos = m_pos;
+            advance();
+            return true;
+        }
+
+    private:
+        int m_radius, m_shell;
+        Vec3i m_pos;
+
+        void advance()
+        {
+            const int d = m_shell;
+            // Inside the x and y faces of the shell, z only takes -d and d
+            if (m_pos.z < d)
+            {
+                m_pos.z = std::abs(m_pos.x) == d || std::abs(m_pos.y) == d ? m_pos.z + 1 : d;
+                return;
+            }
+            if (m_pos.y < d) m_pos.y++;
+            else if (m_pos.x < d)
+            {
+                m_pos.x++;
+                m_pos.y = -d;
+            }
+            else
+            {
+                m_shell++;
+                m_pos = Vec3i(-m_shell, -m_shell, -m_shell);
+                return;
+            }
+            m_pos.z = -d;
+        }
+    };
+}
+
+size_t pregenerateWorld(World& world, ThreadPool& pool, const Vec3i& center, int radius)
+{
+    assert(world.getStorage() != nullptr);
+    WorldStorage& storage = *world.getStorage();
+
+    assert(radius >= 0 && radius <= PregenMaxRadius);
+    // Nearest first, so that an interrupted run leaves a compact generated area
+    ShellWalker walker(radius);
+    const size_t total = size_t(2 * radius + 1) * size_t(2 * radius + 1) * size_t(2 * radius + 1);
+
+    GenerationPipeline& pipeline = world.getGenerationPipeline();
+    const int daylightBrightness = world.getDaylightBrightness();
+    size_t generated = 0, skipped = 0;
+    using Clock = std::chrono::steady_clock;
+    const auto begin = Clock::now();
+    auto lastReport = begin;
+    infostream << "Pre-generating " << total << " chunks on " << pool.getThreadCount() << " threads...";
+    std::vector<Vec3i> batch;
+    Vec3i pos;
+    for (size_t done = 0; done < total;)
+    {
+        // Chunks already saved are skipped, which makes the command resumable
+        batch.clear();
+        for (; batch.size() < PregenBatchSize && walker.next(pos); done++)
+        {
+            if (storage.hasChunk(center + pos)) skipped++;
+            else batch.push_back(center + pos);
+        }
+        pipeline.generate(batch, pool, daylightBrightness);
+        for (const Vec3i& pos : batch)
+        {
+            Chunk chunk(pos);
+            pipeline.take(chunk);
+            world.getJournal()->applyOrphans(chunk);
+            storage.saveChunk(chunk);
+        }
+        generated += batch.size();
+        if (storage.getQueueDepth() > PregenMaxQueuedChunks && !storage.flush())
+        {
+            errorstream << "Pre-generation stopped, chunks can't be saved";
+            break;
+        }
+
+        if (Clock::now() - lastReport < std::chrono::seconds(1)) continue;
+        lastReport = Clock::now();
+        double elapsed = std::chrono::duration<double>(lastReport - begin).count();
+        double rate = generated / elapsed;
+        // Skipped chunks cost nearly nothing, so estimate with the rate of generated ones only
+        size_t left = total - done;
+        infostream << "Pre-generating: " << done << "/" << total << " chunks ("
+                   << done * 100 / total << "%), " << int(rate) << " chunks/s, ETA "
+                   << (rate > 0.0 ? std::to_string(int(left / rate)) + "s" : std::string("unknown"));
+    }
+    // Neighbours generated only partially for the border chunks
+    pipeline.clear();
+    storage.flush();
+    double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+    infostream << "Pre-generation done: " << generated << " chunks generated, " << skipped << " already saved, "
+               << elapsed << "s";
+    return generated;
+}
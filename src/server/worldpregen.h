@@ -0,0 +1,35 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WORLDPREGEN_H_
+#define WORLDPREGEN_H_
+
+#include <world.h>
+#include <threadpool.h>
+
+/// Largest radius world.pregen accepts, (2 * 32 + 1)^3 chunks take hours and tens of gigabytes
+constexpr int PregenMaxRadius = 32;
+
+/// Generate and save all chunks within `radius` (chunks, Chebyshev distance, at most PregenMaxRadius) of `center` on all workers
+/// of `pool`, logging progress. Chunks already saved are skipped, so an interrupted run can be resumed
+/// by running it again. Chunks are generated outside of the world, loaded chunks are not touched.
+/// Return the number of chunks generated. The world must be saved (have storage).
+size_t pregenerateWorld(World& world, ThreadPool& pool, const Vec3i& center, int radius);
+
+#endif // !WORLDPREGEN_H_
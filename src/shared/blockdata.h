@@ -20,6 +20,9 @@
 #ifndef BLOCKDATA_H_
 #define BLOCKDATA_H_
 
+#include <cstdint>
+#include <cstring>
+
 class BlockData
 {
 private:
@@ -36,9 +39,7 @@ public:
     {
     }
 
-    BlockData(const BlockData& rhs) : id(rhs.id), brightness(rhs.brightness), state(rhs.state)
-    {
-    }
+    BlockData(const BlockData& rhs) = default;
 
     bool operator==(const BlockData& rhs) const
     {
@@ -74,6 +75,24 @@ public:
     {
         state = state_;
     }
+
+    // Get the 32-bit representation of this block in memory
+    uint32_t getRawData() const
+    {
+        uint32_t res;
+        memcpy(&res, static_cast<const void*>(this), sizeof(res));
+        return res;
+    }
+
+    // Make block from its 32-bit representation in memory
+    static BlockData fromRawData(uint32_t data)
+    {
+        BlockData res;
+        memcpy(static_cast<void*>(&res), &data, sizeof(data));
+        return res;
+    }
 };
 
+static_assert(sizeof(BlockData) == sizeof(uint32_t), "BlockData must be 32 bits");
+
 #endif // !BLOCKDATA_H_
@@ -0,0 +1,329 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <boost/filesystem/operations.hpp>
+#include "common.h"
+#include "logger.h"
+#include "blockjournal.h"
+
+#ifdef NEWORLD_COMPILER_MSVC
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr uint32_t BatchMagic = 0x424a574e; // "NWJB"
+
+    // FNV-1a, detects torn batches at the end of a segment
+    uint64_t getChecksum(const void* data, size_t length)
+    {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < length; i++) hash = (hash ^ p[i]) * 0x100000001b3ull;
+        return hash;
+    }
+}
+
+BlockJournal::BlockJournal(WorldStorage& storage)
+    : m_storage(storage), m_path(storage.getPath() + "journal/"), m_file(nullptr), m_segment(0), m_oldestSegment(0),
+      m_segmentSize(0), m_replayedCount(0), m_appended(0), m_durable(0), m_failed(false), m_checkpointRequested(false), m_checkpointAt(0),
+      m_checkpointSerial(0), m_stop(false)
+{
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(m_path, ec);
+    if (ec) errorstream << "Failed to create directory \"" << m_path << "\": " << ec.message();
+    uint64_t last = replay();
+    m_failed = !openSegment(last + 1);
+
+    // Replayed edits of unsaved chunks must outlive the old segments
+    std::vector<Record> orphans;
+    for (const auto& item : m_orphans) orphans.insert(orphans.end(), item.second.begin(), item.second.end());
+    if (!m_failed && !orphans.empty()) m_failed = !writeBatch(orphans.data(), orphans.size()) || !sync();
+    // Everything replayed is in the storage or in the new segment now
+    if (!m_failed) m_retiring.emplace_back(last, m_storage.getQueuedSerial());
+    m_storage.flush();
+    retireSegments();
+
+    m_commitThread = std::thread(&BlockJournal::commitThreadFunc, this);
+}
+
+BlockJournal::~BlockJournal()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_appendedCond.notify_one();
+    m_commitThread.join();
+    if (m_file != nullptr) fclose(m_file);
+}
+
+Vec3i BlockJournal::getChunkPos(const Vec3i& pos)
+{
+    return Vec3i(pos.x >= 0 ? pos.x / ChunkSize : (pos.x - ChunkSize + 1) / ChunkSize,
+                 pos.y >= 0 ? pos.y / ChunkSize : (pos.y - ChunkSize + 1) / ChunkSize,
+                 pos.z >= 0 ? pos.z / ChunkSize : (pos.z - ChunkSize + 1) / ChunkSize);
+}
+
+std::string BlockJournal::getSegmentName(uint64_t segment) const
+{
+    return m_path + std::to_string(segment) + ".nwj";
+}
+
+uint64_t BlockJournal::replay()
+{
+    std::vector<uint64_t> segments;
+    boost::system::error_code ec;
+    for (boost::filesystem::directory_iterator iter(m_path, ec), end; !ec && iter != end; iter.increment(ec))
+    {
+        const boost::filesystem::path& file = iter->path();
+        if (file.extension() != ".nwj") continue;
+        try
+        {
+            segments.push_back(std::stoull(file.stem().string()));
+        }
+        catch (std::exception&)
+        {
+            warningstream << "Unknown journal file \"" << file.string() << "\", ignored";
+        }
+    }
+    if (segments.empty()) return 0;
+    std::sort(segments.begin(), segments.end());
+    m_oldestSegment = segments.front();
+
+    // Group edits by chunk, keeping their order
+    std::map<Vec3i, std::vector<Record>> edits;
+    size_t count = 0;
+    for (uint64_t segment : segments)
+    {
+        std::FILE* file = fopen(getSegmentName(segment).c_str(), "rb");
+        if (file == nullptr) continue;
+        BatchHeader header;
+        std::vector<Record> records;
+        while (fread(&header, sizeof(header), 1, file) == 1 && header.magic == BatchMagic)
+        {
+            records.resize(header.count);
+            if (fread(records.data(), sizeof(Record), header.count, file) != header.count ||
+                getChecksum(records.data(), header.count * sizeof(Record)) != header.checksum)
+                break; // Torn batch, it has never been acknowledged
+            for (const Record& record : records)
+                edits[getChunkPos(Vec3i(record.x, record.y, record.z))].push_back(record);
+            count += header.count;
+        }
+        fclose(file);
+    }
+
+    for (const auto& item : edits)
+    {
+        Chunk chunk(item.first);
+        if (!m_storage.loadChunk(chunk))
+        {
+            m_orphans.emplace(item.first, item.second);
+            continue;
+        }
+        for (const Record& record : item.second)
+            chunk.setBlock(Vec3i(record.x, record.y, record.z) - item.first * ChunkSize, BlockData::fromRawData(record.block));
+        m_storage.saveChunk(chunk);
+    }
+    m_replayedCount = count;
+    if (count != 0)
+        infostream << "Replayed " << count << " block edits from the journal (" << m_orphans.size() << " unsaved chunks)";
+    return segments.back();
+}
+
+bool BlockJournal::openSegment(uint64_t segment)
+{
+    std::FILE* file = fopen(getSegmentName(segment).c_str(), "wb");
+    if (file == nullptr)
+    {
+        errorstream << "Failed to create journal segment \"" << getSegmentName(segment) << "\"";
+        return false;
+    }
+    if (m_file != nullptr) fclose(m_file);
+    m_file = file;
+    m_segment = segment;
+    m_segmentSize = 0;
+    return true;
+}
+
+bool BlockJournal::writeBatch(const Record* records, size_t count)
+{
+    BatchHeader header;
+    header.magic = BatchMagic;
+    header.count = uint32_t(count);
+    header.checksum = getChecksum(records, count * sizeof(Record));
+    if (fwrite(&header, sizeof(header), 1, m_file) != 1 || fwrite(records, sizeof(Record), count, m_file) != count)
+    {
+        errorstream << "Failed to write journal segment \"" << getSegmentName(m_segment) << "\"";
+        return false;
+    }
+    m_segmentSize += sizeof(header) + count * sizeof(Record);
+    return true;
+}
+
+bool BlockJournal::sync()
+{
+    if (fflush(m_file) != 0) return false;
+#ifdef NEWORLD_COMPILER_MSVC
+    return _commit(_fileno(m_file)) == 0;
+#else
+    return fsync(fileno(m_file)) == 0;
+#endif
+}
+
+void BlockJournal::retireSegments()
+{
+    size_t done = 0;
+    // Saves which failed are retried and don't count as written, so their edits stay in the journal
+    while (done < m_retiring.size() && m_storage.isWritten(m_retiring[done].second))
+    {
+        for (; m_oldestSegment <= m_retiring[done].first; m_oldestSegment++)
+        {
+            boost::system::error_code ec;
+            boost::filesystem::remove(getSegmentName(m_oldestSegment), ec);
+        }
+        done++;
+    }
+    m_retiring.erase(m_retiring.begin(), m_retiring.begin() + done);
+}
+
+uint64_t BlockJournal::append(const Vec3i& pos, BlockData block)
+{
+    Record record;
+    record.x = pos.x;
+    record.y = pos.y;
+    record.z = pos.z;
+    record.block = block.getRawData();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_buffer.push_back(record);
+    // Only wake up the commit thread for the first edit of a group, the rest are picked up with it
+    if (m_buffer.size() == 1) m_appendedCond.notify_one();
+    return ++m_appended;
+}
+
+uint64_t BlockJournal::append(const std::vector<std::pair<Vec3i, BlockData>>& edits)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (edits.empty()) return m_appended;
+    if (m_buffer.empty()) m_appendedCond.notify_one();
+    m_buffer.reserve(m_buffer.size() + edits.size());
+    for (const auto& edit : edits)
+    {
+        Record record;
+        record.x = edit.first.x;
+        record.y = edit.first.y;
+        record.z = edit.first.z;
+        record.block = edit.second.getRawData();
+        m_buffer.push_back(record);
+    }
+    return m_appended += edits.size();
+}
+
+bool BlockJournal::waitDurable(uint64_t seq)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_committedCond.wait(lock, [this, seq] { return m_durable >= seq || m_failed; });
+    return m_durable >= seq;
+}
+
+uint64_t BlockJournal::getDurableSequence() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_durable;
+}
+
+void BlockJournal::applyOrphans(Chunk& chunk)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_orphans.empty()) return;
+    auto iter = m_orphans.find(chunk.getPosition());
+    if (iter == m_orphans.end()) return;
+    Vec3i base = chunk.getPosition() * ChunkSize;
+    for (const Record& record : iter->second)
+        chunk.setBlock(Vec3i(record.x, record.y, record.z) - base, BlockData::fromRawData(record.block));
+    m_orphans.erase(iter);
+}
+
+void BlockJournal::checkpoint()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_checkpointRequested = true;
+    m_checkpointAt = m_buffer.size();
+    m_checkpointSerial = m_storage.getQueuedSerial();
+    // Chunks which get their orphans later are not covered by the chunk saves of this checkpoint
+    m_checkpointOrphans.clear();
+    for (const auto& item : m_orphans)
+        m_checkpointOrphans.insert(m_checkpointOrphans.end(), item.second.begin(), item.second.end());
+    m_appendedCond.notify_one();
+}
+
+void BlockJournal::commitThreadFunc()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        // Poll now and then for segments to retire
+        m_appendedCond.wait_for(lock, std::chrono::milliseconds(100),
+                                [this] { return m_stop || !m_buffer.empty() || m_checkpointRequested; });
+        m_committing.swap(m_buffer);
+        uint64_t seq = m_appended;
+        bool checkpoint = m_checkpointRequested;
+        size_t checkpointAt = m_checkpointAt;
+        uint64_t checkpointSerial = m_checkpointSerial;
+        std::vector<Record> orphans;
+        if (checkpoint) orphans.swap(m_checkpointOrphans);
+        bool ok = !m_failed;
+        lock.unlock();
+
+        if (ok && checkpoint)
+        {
+            // Edits before the checkpoint stay in the old segment, which is dropped with the chunk saves
+            if (checkpointAt != 0) ok = writeBatch(m_committing.data(), checkpointAt) && sync();
+            if (ok)
+            {
+                uint64_t old = m_segment;
+                ok = openSegment(old + 1);
+                if (ok) m_retiring.emplace_back(old, checkpointSerial);
+            }
+            if (ok && !orphans.empty()) ok = writeBatch(orphans.data(), orphans.size());
+            if (ok && m_committing.size() > checkpointAt)
+                ok = writeBatch(m_committing.data() + checkpointAt, m_committing.size() - checkpointAt);
+            if (ok) ok = sync();
+        }
+        else if (ok && !m_committing.empty())
+            ok = writeBatch(m_committing.data(), m_committing.size()) && sync();
+        m_committing.clear();
+        retireSegments();
+
+        lock.lock();
+        if (checkpoint) m_checkpointRequested = false;
+        if (ok) m_durable = seq;
+        else if (!m_failed)
+        {
+            errorstream << "Block journal failed, further edits are not crash-safe";
+            m_failed = true;
+        }
+        m_committedCond.notify_all();
+        if (m_stop && m_buffer.empty() && !m_checkpointRequested) break;
+    }
+}
@@ -0,0 +1,154 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BLOCKJOURNAL_H_
+#define BLOCKJOURNAL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/core/noncopyable.hpp>
+#include "chunk.h"
+#include "worldstorage.h"
+
+/// Size of the current journal segment which triggers a compaction (bytes)
+constexpr uint64_t JournalCompactionSize = 64 * 1024 * 1024;
+
+/// Write-ahead journal of block edits, so that edits made since the last chunk save survive a crash.
+/// Edits are appended to a buffer and committed in groups by a dedicated thread, one fsync per group.
+/// append() doesn't wait: an edit is only crash-safe once its group is committed, usually a few milliseconds
+/// later (one fsync). Whatever must not be acknowledged before that waits with waitDurable().
+/// The journal is split into segments ("journal/<n>.nwj"): a checkpoint starts a new segment,
+/// and older segments are deleted once the chunk saves queued before the checkpoint are on the disk.
+class BlockJournal :boost::noncopyable
+{
+public:
+    /// Replay the journal left by the previous run into `storage`, then start a new segment
+    explicit BlockJournal(WorldStorage& storage);
+    /// Commit remaining edits and stop the commit thread
+    ~BlockJournal();
+
+    /// Append an edit (world position), return its sequence number
+    uint64_t append(const Vec3i& pos, BlockData block);
+    /// Append a group of edits (world positions), return the sequence number of the last one
+    uint64_t append(const std::vector<std::pair<Vec3i, BlockData>>& edits);
+    /// Wait until the edit `seq` is on the disk, return false if the journal failed to write it
+    bool waitDurable(uint64_t seq);
+
+    /// Get the sequence number of the last edit on the disk
+    uint64_t getDurableSequence() const;
+
+    /// Get the number of edits replayed on startup
+    size_t getReplayedCount() const
+    {
+        return m_replayedCount;
+    }
+
+    /// Apply replayed edits of a chunk which was not saved in the storage (e.g. freshly generated)
+    void applyOrphans(Chunk& chunk);
+
+    /// Should the world checkpoint the journal
+    bool needsCompaction() const
+    {
+        return m_segmentSize >= JournalCompactionSize && !m_checkpointRequested;
+    }
+
+    /// Start a new segment. Must be called after all loaded chunks are queued for saving:
+    /// older segments are dropped once these saves are written.
+    void checkpoint();
+
+private:
+    /// Journal record (native byte order, same as region files)
+    struct Record
+    {
+        int32_t x, y, z;
+        uint32_t block;
+    };
+
+    /// Header of a group of records
+    struct BatchHeader
+    {
+        uint32_t magic;
+        uint32_t count;
+        uint64_t checksum;
+    };
+
+    WorldStorage& m_storage;
+    /// Directory of journal segments
+    std::string m_path;
+    /// Current segment
+    std::FILE* m_file;
+    uint64_t m_segment;
+    /// Oldest segment not deleted yet
+    uint64_t m_oldestSegment;
+    std::atomic<uint64_t> m_segmentSize;
+    /// Edits replayed on startup
+    size_t m_replayedCount;
+    /// Segments waiting for chunk saves: (last segment to delete, storage serial to wait for)
+    std::vector<std::pair<uint64_t, uint64_t>> m_retiring;
+
+    /// Edits waiting for the next commit
+    std::vector<Record> m_buffer;
+    /// Edits being committed (only used by the commit thread)
+    std::vector<Record> m_committing;
+    /// Sequence numbers of the last appended and the last committed edit
+    uint64_t m_appended, m_durable;
+    bool m_failed;
+    /// A checkpoint is requested, edits from m_buffer[m_checkpointAt] go into the new segment
+    std::atomic<bool> m_checkpointRequested;
+    size_t m_checkpointAt;
+    uint64_t m_checkpointSerial;
+    /// Orphans at the time of the checkpoint, rewritten into the new segment
+    std::vector<Record> m_checkpointOrphans;
+    /// Replayed edits of chunks which were not saved, by chunk position
+    std::map<Vec3i, std::vector<Record>> m_orphans;
+    /// Protects everything above except the commit thread states
+    mutable std::mutex m_mutex;
+    /// Signaled when edits are appended or the commit thread should stop
+    std::condition_variable m_appendedCond;
+    /// Signaled when edits are committed
+    std::condition_variable m_committedCond;
+    bool m_stop;
+    std::thread m_commitThread;
+
+    /// Convert world position to chunk position
+    static Vec3i getChunkPos(const Vec3i& pos);
+    /// Get segment filename
+    std::string getSegmentName(uint64_t segment) const;
+    /// Merge all segments on the disk into the storage, return the last segment number
+    uint64_t replay();
+    /// Create and open a segment
+    bool openSegment(uint64_t segment);
+    /// Append a group of records to the current segment
+    bool writeBatch(const Record* records, size_t count);
+    /// Flush the current segment to the disk
+    bool sync();
+    /// Delete segments whose chunk saves are written
+    void retireSegments();
+    /// Commit thread main loop
+    void commitThreadFunc();
+};
+
+#endif // !BLOCKJOURNAL_H_
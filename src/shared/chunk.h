@@ -21,24 +21,46 @@
 #define CHUNK_H_
 
 #include <cassert>
+#include <memory>
+#include <boost/core/noncopyable.hpp>
 #include "vec3.h"
 #include "blockdata.h"
+#include "chunkattachments.h"
 
 constexpr int ChunkSizeLog2 = 5, ChunkSize = 1 << ChunkSizeLog2; // 2 ^ ChunkSizeLog2 == 32
+constexpr int ChunkBlockCount = ChunkSize * ChunkSize * ChunkSize;
 
-class Chunk
+class Chunk :boost::noncopyable
 {
 public:
-    explicit Chunk(const Vec3i& position) : m_position(position)
+    explicit Chunk(const Vec3i& position)
+        : m_position(position), m_ownedBlocks(new BlockData[ChunkBlockCount]), m_blocks(m_ownedBlocks.get()), m_dirty(true)
     {
     }
 
+    /// Use external memory (e.g. a private file mapping) as block storage without copying.
+    /// `keeper` keeps the memory alive as long as this chunk uses it.
+    void adoptBlocks(BlockData* blocks, std::shared_ptr<void> keeper)
+    {
+        assert(blocks != nullptr);
+        m_blocks = blocks;
+        m_blocksKeeper = std::move(keeper);
+        m_ownedBlocks.reset();
+    }
+
     /// Get chunk position
     const Vec3i& getPosition() const
     {
         return m_position;
     }
 
+    /// Get the index of a block in the block array
+    static int getBlockIndex(const Vec3i& pos)
+    {
+        assert(pos.x >= 0 && pos.x < ChunkSize && pos.y >= 0 && pos.y < ChunkSize && pos.z >= 0 && pos.z < ChunkSize);
+        return pos.x * ChunkSize * ChunkSize + pos.y * ChunkSize + pos.z;
+    }
+
     /// Get block data in this chunk
     BlockData getBlock(const Vec3i& pos) const
     {
@@ -56,16 +78,71 @@ public:
     /// Get block pointer
     BlockData* getBlocks() { return m_blocks; }
 
+    /// Get block pointer
+    const BlockData* getBlocks() const { return m_blocks; }
+
     /// Set block data in this chunk
     void setBlock(const Vec3i& pos, BlockData block)
     {
         assert(pos.x >= 0 && pos.x < ChunkSize && pos.y >= 0 && pos.y < ChunkSize && pos.z >= 0 && pos.z < ChunkSize);
         m_blocks[pos.x * ChunkSize * ChunkSize + pos.y * ChunkSize + pos.z] = block;
+        m_dirty = true;
+    }
+
+    /// Has the chunk changed since it was saved or loaded. New chunks are dirty.
+    /// setBlock() marks the chunk, other changes through block pointers or attachments have to mark it themselves.
+    bool isDirty() const
+    {
+        return m_dirty;
+    }
+
+    void setDirty(bool dirty)
+    {
+        m_dirty = dirty;
+    }
+
+    /// Get plugin attachments, nullptr if the chunk has none
+    ChunkAttachments* getAttachments() { return m_attachments.get(); }
+
+    /// Get plugin attachments, nullptr if the chunk has none
+    const ChunkAttachments* getAttachments() const { return m_attachments.get(); }
+
+    /// Get plugin attachments, create them if the chunk has none
+    ChunkAttachments& getOrCreateAttachments()
+    {
+        if (m_attachments == nullptr) m_attachments.reset(new ChunkAttachments());
+        return *m_attachments;
+    }
+
+    /// Replace plugin attachments, nullptr drops them
+    void setAttachments(std::unique_ptr<ChunkAttachments> attachments)
+    {
+        m_attachments = std::move(attachments);
+    }
+
+    /// Call `func(BlockData* run, const Vec3i& pos, int length)` for each contiguous run of blocks (along z)
+    /// in the box [min, max] (in this chunk, inclusive). `pos` is the position of the first block of the run.
+    template <typename Func>
+    void forEachRun(const Vec3i& min, const Vec3i& max, Func func)
+    {
+        assert(min.x >= 0 && min.y >= 0 && min.z >= 0 && max.x < ChunkSize && max.y < ChunkSize && max.z < ChunkSize);
+        for (int x = min.x; x <= max.x; x++)
+            for (int y = min.y; y <= max.y; y++)
+                func(m_blocks + x * ChunkSize * ChunkSize + y * ChunkSize + min.z, Vec3i(x, y, min.z), max.z - min.z + 1);
     }
 
 private:
     Vec3i m_position;
-    BlockData m_blocks[ChunkSize * ChunkSize * ChunkSize];
+    /// Block storage allocated by this chunk, empty when the storage is adopted
+    std::unique_ptr<BlockData[]> m_ownedBlocks;
+    /// Owner of adopted block storage
+    std::shared_ptr<void> m_blocksKeeper;
+    /// Blocks (points to m_ownedBlocks or adopted storage)
+    BlockData* m_blocks;
+    /// Plugin data attached to blocks, only allocated for chunks which have any
+    std::unique_ptr<ChunkAttachments> m_attachments;
+    /// Changed since saved or loaded
+    bool m_dirty;
 };
 
 #endif // !CHUNK_H_
@@ -0,0 +1,162 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include "chunkattachments.h"
+#include "chunk.h"
+
+namespace
+{
+    constexpr size_t MinSlotCount = 8;
+
+    /// Serialized attachment header, followed by `length` bytes of data
+    struct RecordHeader
+    {
+        uint32_t plugin;
+        uint32_t blockIndex;
+        uint32_t length;
+    };
+}
+
+uint32_t getAttachmentPluginID(const char* internalName)
+{
+    uint32_t res = 2166136261u;
+    for (const char* p = internalName; *p != '\0'; p++) res = (res ^ uint8_t(*p)) * 16777619u;
+    return res;
+}
+
+size_t ChunkAttachments::find(uint64_t key) const
+{
+    if (m_count == 0) return m_slots.size();
+    const size_t mask = m_slots.size() - 1;
+    for (size_t i = getHome(key); ; i = (i + 1) & mask)
+    {
+        if (m_slots[i].key == key) return i;
+        if (m_slots[i].key == EmptyKey) return m_slots.size();
+    }
+}
+
+const std::vector<uint8_t>* ChunkAttachments::get(uint32_t plugin, int blockIndex) const
+{
+    size_t slot = find(makeKey(plugin, blockIndex));
+    return slot != m_slots.size() ? &m_slots[slot].data : nullptr;
+}
+
+void ChunkAttachments::set(uint32_t plugin, int blockIndex, const uint8_t* data, size_t length)
+{
+    if (length == 0)
+    {
+        remove(plugin, blockIndex);
+        return;
+    }
+    const uint64_t key = makeKey(plugin, blockIndex);
+    size_t slot = find(key);
+    if (slot == m_slots.size())
+    {
+        if ((m_count + 1) * 4 > m_slots.size() * 3) grow();
+        const size_t mask = m_slots.size() - 1;
+        for (slot = getHome(key); m_slots[slot].key != EmptyKey; slot = (slot + 1) & mask);
+        m_slots[slot].key = key;
+        m_count++;
+    }
+    m_slots[slot].data.assign(data, data + length);
+}
+
+bool ChunkAttachments::remove(uint32_t plugin, int blockIndex)
+{
+    size_t hole = find(makeKey(plugin, blockIndex));
+    if (hole == m_slots.size()) return false;
+    // Backward shift deletion: move later entries of the probe sequence into the hole, so no tombstones are needed
+    const size_t mask = m_slots.size() - 1;
+    for (size_t i = (hole + 1) & mask; m_slots[i].key != EmptyKey; i = (i + 1) & mask)
+    {
+        // An entry may fill the hole if its home is not in (hole, i]
+        size_t home = getHome(m_slots[i].key);
+        if (((i - home) & mask) < ((i - hole) & mask)) continue;
+        m_slots[hole] = std::move(m_slots[i]);
+        hole = i;
+    }
+    m_slots[hole].key = EmptyKey;
+    std::vector<uint8_t>().swap(m_slots[hole].data);
+    m_count--;
+    return true;
+}
+
+void ChunkAttachments::grow()
+{
+    std::vector<Slot> old(std::max(MinSlotCount, m_slots.size() * 2));
+    old.swap(m_slots);
+    m_shift = 64;
+    for (size_t size = m_slots.size(); size > 1; size >>= 1) m_shift--;
+    const size_t mask = m_slots.size() - 1;
+    for (Slot& item : old)
+    {
+        if (item.key == EmptyKey) continue;
+        size_t slot = getHome(item.key);
+        while (m_slots[slot].key != EmptyKey) slot = (slot + 1) & mask;
+        m_slots[slot] = std::move(item);
+    }
+}
+
+void ChunkAttachments::serialize(std::vector<uint8_t>& out) const
+{
+    // In key order, so that equal attachments serialize to equal bytes
+    std::vector<const Slot*> slots;
+    slots.reserve(m_count);
+    for (const Slot& slot : m_slots)
+        if (slot.key != EmptyKey) slots.push_back(&slot);
+    std::sort(slots.begin(), slots.end(), [](const Slot* lhs, const Slot* rhs) { return lhs->key < rhs->key; });
+
+    uint32_t count = uint32_t(slots.size());
+    size_t offset = out.size();
+    out.resize(offset + sizeof(count));
+    memcpy(out.data() + offset, &count, sizeof(count));
+    for (const Slot* slot : slots)
+    {
+        RecordHeader header;
+        header.plugin = uint32_t(slot->key >> 32);
+        header.blockIndex = uint32_t(slot->key);
+        header.length = uint32_t(slot->data.size());
+        offset = out.size();
+        out.resize(offset + sizeof(header) + slot->data.size());
+        memcpy(out.data() + offset, &header, sizeof(header));
+        memcpy(out.data() + offset + sizeof(header), slot->data.data(), slot->data.size());
+    }
+}
+
+bool ChunkAttachments::deserialize(const uint8_t* data, size_t length)
+{
+    *this = ChunkAttachments();
+    uint32_t count;
+    if (length < sizeof(count)) return false;
+    memcpy(&count, data, sizeof(count));
+    const uint8_t *p = data + sizeof(count), *end = data + length;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        RecordHeader header;
+        if (size_t(end - p) < sizeof(header)) return false;
+        memcpy(&header, p, sizeof(header));
+        p += sizeof(header);
+        if (header.length == 0 || header.blockIndex >= uint32_t(ChunkBlockCount) || size_t(end - p) < header.length) return false;
+        set(header.plugin, int(header.blockIndex), p, header.length);
+        p += header.length;
+    }
+    return p == end;
+}
@@ -0,0 +1,98 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHUNKATTACHMENTS_H_
+#define CHUNKATTACHMENTS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Largest data attached to one block, same as NW_ATTACHMENT_MAX_LENGTH in nwapi.h
+constexpr size_t MaxAttachmentLength = 65536;
+
+/// Get the ID under which a plugin stores attachments (FNV-1a of its internal name), stable across runs
+uint32_t getAttachmentPluginID(const char* internalName);
+
+/// Plugin data attached to the blocks of a chunk, keyed by plugin ID and block index.
+/// A flat open addressing table (linear probing), so lookups are O(1) and there are no nodes to allocate.
+class ChunkAttachments
+{
+public:
+    ChunkAttachments() : m_count(0), m_shift(64)
+    {
+    }
+
+    /// Get the data attached by a plugin to a block, nullptr if there is none
+    const std::vector<uint8_t>* get(uint32_t plugin, int blockIndex) const;
+    /// Attach data to a block, replacing the previous data of the plugin. Empty data removes the attachment.
+    void set(uint32_t plugin, int blockIndex, const uint8_t* data, size_t length);
+    /// Remove an attachment, return false if there is none
+    bool remove(uint32_t plugin, int blockIndex);
+
+    /// Get the number of attachments
+    size_t size() const
+    {
+        return m_count;
+    }
+
+    bool empty() const
+    {
+        return m_count == 0;
+    }
+
+    /// Append the attachments to `out` (native byte order, same as region files)
+    void serialize(std::vector<uint8_t>& out) const;
+    /// Replace the attachments by serialized ones, return false if the data is malformed
+    bool deserialize(const uint8_t* data, size_t length);
+
+private:
+    /// Free slots have this key, which no plugin ID and block index produce
+    static constexpr uint64_t EmptyKey = ~uint64_t(0);
+
+    struct Slot
+    {
+        uint64_t key = EmptyKey;
+        std::vector<uint8_t> data;
+    };
+
+    /// Power of two sized, at most 3/4 full
+    std::vector<Slot> m_slots;
+    size_t m_count;
+    /// 64 - log2(slot count), for Fibonacci hashing
+    int m_shift;
+
+    static uint64_t makeKey(uint32_t plugin, int blockIndex)
+    {
+        return uint64_t(plugin) << 32 | uint32_t(blockIndex);
+    }
+
+    /// Preferred slot of a key
+    size_t getHome(uint64_t key) const
+    {
+        return size_t((key * 0x9e3779b97f4a7c15ull) >> m_shift);
+    }
+
+    /// Get the slot of a key, m_slots.size() if it is not in the table
+    size_t find(uint64_t key) const;
+    /// Double the slot count
+    void grow();
+};
+
+#endif // !CHUNKATTACHMENTS_H_
@@ -0,0 +1,88 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "chunkcodec.h"
+#include "chunkcache.h"
+
+void ChunkCache::put(const Chunk& chunk)
+{
+    erase(chunk.getPosition());
+    Entry entry;
+    entry.position = chunk.getPosition();
+    ChunkCodec::encode(chunk.getBlocks(), chunk.getAttachments(), entry.data);
+    entry.data.shrink_to_fit();
+    insert(std::move(entry));
+}
+
+void ChunkCache::putEncoded(const Vec3i& chunkPos, const uint8_t* data, size_t length)
+{
+    erase(chunkPos);
+    Entry entry;
+    entry.position = chunkPos;
+    entry.data.assign(data, data + length);
+    insert(std::move(entry));
+}
+
+void ChunkCache::insert(Entry&& entry)
+{
+    m_size += entry.data.size();
+    Vec3i chunkPos = entry.position;
+    m_lru.push_front(std::move(entry));
+    m_chunks[chunkPos] = m_lru.begin();
+    shrink();
+}
+
+bool ChunkCache::take(Chunk& chunk)
+{
+    auto iter = m_chunks.find(chunk.getPosition());
+    if (iter == m_chunks.end())
+    {
+        m_misses++;
+        return false;
+    }
+    const std::vector<uint8_t>& data = iter->second->data;
+    bool res = ChunkCodec::decode(data.data(), data.size(), chunk);
+    erase(iter);
+    if (res)
+    {
+        // Cached chunks are saved
+        chunk.setDirty(false);
+        m_hits++;
+    }
+    else m_misses++;
+    return res;
+}
+
+void ChunkCache::erase(const Vec3i& chunkPos)
+{
+    auto iter = m_chunks.find(chunkPos);
+    if (iter != m_chunks.end()) erase(iter);
+}
+
+void ChunkCache::erase(std::map<Vec3i, std::list<Entry>::iterator>::iterator iter)
+{
+    m_size -= iter->second->data.size();
+    m_lru.erase(iter->second);
+    m_chunks.erase(iter);
+}
+
+void ChunkCache::shrink()
+{
+    while (m_size > m_budget && !m_lru.empty()) erase(m_chunks.find(m_lru.back().position));
+}
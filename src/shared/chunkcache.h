@@ -0,0 +1,113 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHUNKCACHE_H_
+#define CHUNKCACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <vector>
+#include <boost/core/noncopyable.hpp>
+#include "chunk.h"
+
+/// Default memory budget of the chunk cache (bytes)
+constexpr size_t DefaultChunkCacheBudget = 64 * 1024 * 1024;
+
+/// Warm tier between loaded and unloaded chunks: recently unloaded chunks are kept compressed in memory,
+/// so that loading them again takes neither generation nor disk I/O. Least recently unloaded chunks are
+/// dropped when the byte budget is exceeded. Only contains chunks which are also saved, so dropping is free.
+class ChunkCache :boost::noncopyable
+{
+public:
+    explicit ChunkCache(size_t budget = DefaultChunkCacheBudget)
+        : m_budget(budget), m_size(0), m_hits(0), m_misses(0)
+    {
+    }
+
+    /// Keep an unloaded chunk, replacing the older copy
+    void put(const Chunk& chunk);
+    /// Keep a chunk which is already encoded by ChunkCodec, replacing the older copy
+    void putEncoded(const Vec3i& chunkPos, const uint8_t* data, size_t length);
+    /// Restore a chunk and remove it from the cache, return false if it is not cached
+    bool take(Chunk& chunk);
+    /// Drop a cached chunk
+    void erase(const Vec3i& chunkPos);
+
+    /// Set memory budget (bytes), dropping chunks if necessary
+    void setBudget(size_t budget)
+    {
+        m_budget = budget;
+        shrink();
+    }
+
+    /// Get memory budget (bytes)
+    size_t getBudget() const
+    {
+        return m_budget;
+    }
+
+    /// Get memory used by cached chunks (bytes)
+    size_t getSize() const
+    {
+        return m_size;
+    }
+
+    /// Get cached chunk count
+    size_t getChunkCount() const
+    {
+        return m_chunks.size();
+    }
+
+    /// Get the number of take() calls which found the chunk
+    uint64_t getHits() const
+    {
+        return m_hits;
+    }
+
+    /// Get the number of take() calls which didn't find the chunk
+    uint64_t getMisses() const
+    {
+        return m_misses;
+    }
+
+private:
+    struct Entry
+    {
+        Vec3i position;
+        std::vector<uint8_t> data;
+    };
+
+    size_t m_budget, m_size;
+    /// Cached chunks, most recently put first
+    std::list<Entry> m_lru;
+    /// Position to cached chunk
+    std::map<Vec3i, std::list<Entry>::iterator> m_chunks;
+    std::atomic<uint64_t> m_hits, m_misses;
+
+    /// Drop least recently put chunks until the budget is met
+    void shrink();
+    /// Add an entry as the most recently put one
+    void insert(Entry&& entry);
+    /// Remove an entry
+    void erase(std::map<Vec3i, std::list<Entry>::iterator>::iterator iter);
+};
+
+#endif // !CHUNKCACHE_H_
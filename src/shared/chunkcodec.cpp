@@ -0,0 +1,276 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include "chunkcodec.h"
+
+namespace ChunkCodec
+{
+    namespace
+    {
+        enum class Mode : uint8_t
+        {
+            uniform = 0,
+            packed = 1,
+            runLength = 2
+        };
+
+        // Linear palette search is faster than hashing for the few block kinds a chunk usually has
+        constexpr size_t LinearPaletteLimit = 32;
+
+        void writeVarint(std::vector<uint8_t>& out, uint32_t value)
+        {
+            while (value >= 0x80)
+            {
+                out.push_back(uint8_t(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(uint8_t(value));
+        }
+
+        bool readVarint(const uint8_t*& p, const uint8_t* end, uint32_t& value)
+        {
+            if (p < end && *p < 0x80)
+            {
+                value = *p++;
+                return true;
+            }
+            value = 0;
+            for (int shift = 0; shift < 35 && p < end; shift += 7)
+            {
+                uint8_t byte = *p++;
+                value |= uint32_t(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) return true;
+            }
+            return false;
+        }
+
+        // Bits per palette index, rounded up to a power of two so that indices never straddle 64-bit words
+        int getIndexBits(size_t paletteSize)
+        {
+            int bits = 1;
+            while ((size_t(1) << bits) < paletteSize) bits <<= 1;
+            return bits;
+        }
+
+        uint64_t loadLE64(const uint8_t* p)
+        {
+            uint64_t res = 0;
+            for (int i = 7; i >= 0; i--) res = res << 8 | p[i];
+            return res;
+        }
+
+        void storeLE64(uint8_t* p, uint64_t value)
+        {
+            for (int i = 0; i < 8; i++, value >>= 8) p[i] = uint8_t(value);
+        }
+
+        // Find palette indices of all blocks
+        void buildPalette(const BlockData* blocks, std::vector<uint32_t>& palette, uint16_t* indices)
+        {
+            std::unordered_map<uint32_t, uint16_t> lookup;
+            uint32_t last = blocks[0].getRawData();
+            uint16_t lastIndex = 0;
+            palette.push_back(last);
+            for (int i = 0; i < ChunkBlockCount; i++)
+            {
+                uint32_t word = blocks[i].getRawData();
+                if (word != last)
+                {
+                    if (palette.size() <= LinearPaletteLimit)
+                    {
+                        lastIndex = uint16_t(std::find(palette.begin(), palette.end(), word) - palette.begin());
+                        if (lastIndex == palette.size()) palette.push_back(word);
+                        if (palette.size() > LinearPaletteLimit)
+                            for (size_t j = 0; j < palette.size(); j++) lookup.emplace(palette[j], uint16_t(j));
+                    }
+                    else
+                    {
+                        auto res = lookup.emplace(word, uint16_t(palette.size()));
+                        if (res.second) palette.push_back(word);
+                        lastIndex = res.first->second;
+                    }
+                    last = word;
+                }
+                indices[i] = lastIndex;
+            }
+        }
+
+        void encodeRunLength(const uint16_t* indices, int bits, std::vector<uint8_t>& out)
+        {
+            for (int i = 0; i < ChunkBlockCount;)
+            {
+                int j = i + 1;
+                while (j < ChunkBlockCount && indices[j] == indices[i]) j++;
+                writeVarint(out, uint32_t(j - i - 1) << bits | indices[i]);
+                i = j;
+            }
+        }
+
+        void encodePacked(const uint16_t* indices, int bits, std::vector<uint8_t>& out)
+        {
+            const int perWord = 64 / bits;
+            size_t pos = out.size();
+            out.resize(pos + ChunkBlockCount / perWord * 8);
+            for (int i = 0; i < ChunkBlockCount; i += perWord, pos += 8)
+            {
+                uint64_t word = 0;
+                for (int j = perWord - 1; j >= 0; j--) word = word << bits | indices[i + j];
+                storeLE64(&out[pos], word);
+            }
+        }
+
+        const uint8_t* decodeRunLength(const uint8_t* p, const uint8_t* end, const BlockData* palette, uint32_t paletteSize,
+                                       int bits, BlockData* blocks)
+        {
+            const uint32_t mask = (1u << bits) - 1;
+            for (int i = 0; i < ChunkBlockCount;)
+            {
+                uint32_t token;
+                if (!readVarint(p, end, token)) return nullptr;
+                uint32_t index = token & mask, run = (token >> bits) + 1;
+                if (index >= paletteSize || run > uint32_t(ChunkBlockCount - i)) return nullptr;
+                std::fill_n(blocks + i, run, palette[index]);
+                i += run;
+            }
+            return p;
+        }
+
+        template <int Bits>
+        const uint8_t* decodePacked(const uint8_t* p, const uint8_t* end, const BlockData* palette, uint32_t paletteSize,
+                                    BlockData* blocks)
+        {
+            constexpr int PerWord = 64 / Bits;
+            constexpr uint64_t Mask = (uint64_t(1) << Bits) - 1;
+            if (size_t(end - p) < size_t(ChunkBlockCount / PerWord * 8)) return nullptr;
+            // Indices beyond the palette are only possible when the palette size isn't a power of two
+            bool checkRange = paletteSize != (1u << Bits);
+            for (int i = 0; i < ChunkBlockCount; i += PerWord, p += 8)
+            {
+                uint64_t word = loadLE64(p);
+                for (int j = 0; j < PerWord; j++, word >>= Bits)
+                {
+                    uint32_t index = uint32_t(word & Mask);
+                    if (checkRange && index >= paletteSize) return nullptr;
+                    blocks[i + j] = palette[index];
+                }
+            }
+            return p;
+        }
+    }
+
+    void encode(const BlockData* blocks, std::vector<uint8_t>& out)
+    {
+        std::vector<uint32_t> palette;
+        std::unique_ptr<uint16_t[]> indices(new uint16_t[ChunkBlockCount]);
+        buildPalette(blocks, palette, indices.get());
+
+        size_t start = out.size();
+        out.push_back(uint8_t(palette.size() == 1 ? Mode::uniform : Mode::runLength));
+        writeVarint(out, uint32_t(palette.size()));
+        for (uint32_t word : palette) writeVarint(out, word);
+        if (palette.size() == 1) return;
+
+        // Run-length coding wins on natural terrain, fall back to bit-packing on noisy chunks
+        int bits = getIndexBits(palette.size());
+        size_t header = out.size();
+        encodeRunLength(indices.get(), bits, out);
+        size_t packedSize = ChunkBlockCount * bits / 8;
+        if (out.size() - header > packedSize)
+        {
+            out.resize(header);
+            out[start] = uint8_t(Mode::packed);
+            encodePacked(indices.get(), bits, out);
+        }
+    }
+
+    size_t decode(const uint8_t* data, size_t length, BlockData* blocks)
+    {
+        const uint8_t* p = data;
+        const uint8_t* end = data + length;
+        uint32_t paletteSize;
+        if (length < 2) return 0;
+        Mode mode = Mode(*p++);
+        if (!readVarint(p, end, paletteSize) || paletteSize == 0 || paletteSize > ChunkBlockCount) return 0;
+
+        BlockData smallPalette[LinearPaletteLimit];
+        std::unique_ptr<BlockData[]> largePalette;
+        BlockData* palette = smallPalette;
+        if (paletteSize > LinearPaletteLimit)
+        {
+            largePalette.reset(new BlockData[paletteSize]);
+            palette = largePalette.get();
+        }
+        for (uint32_t i = 0; i < paletteSize; i++)
+        {
+            uint32_t word;
+            if (!readVarint(p, end, word)) return 0;
+            palette[i] = BlockData::fromRawData(word);
+        }
+
+        int bits = getIndexBits(paletteSize);
+        switch (mode)
+        {
+        case Mode::uniform:
+            if (paletteSize != 1) return 0;
+            std::fill_n(blocks, ChunkBlockCount, palette[0]);
+            break;
+        case Mode::runLength:
+            p = decodeRunLength(p, end, palette, paletteSize, bits, blocks);
+            break;
+        case Mode::packed:
+            switch (bits)
+            {
+            case 1: p = decodePacked<1>(p, end, palette, paletteSize, blocks); break;
+            case 2: p = decodePacked<2>(p, end, palette, paletteSize, blocks); break;
+            case 4: p = decodePacked<4>(p, end, palette, paletteSize, blocks); break;
+            case 8: p = decodePacked<8>(p, end, palette, paletteSize, blocks); break;
+            case 16: p = decodePacked<16>(p, end, palette, paletteSize, blocks); break;
+            default: return 0;
+            }
+            break;
+        default:
+            return 0;
+        }
+        return p == nullptr ? 0 : size_t(p - data);
+    }
+
+    void encode(const BlockData* blocks, const ChunkAttachments* attachments, std::vector<uint8_t>& out)
+    {
+        encode(blocks, out);
+        if (attachments != nullptr && !attachments->empty()) attachments->serialize(out);
+    }
+
+    bool decode(const uint8_t* data, size_t length, Chunk& chunk)
+    {
+        size_t used = decode(data, length, chunk.getBlocks());
+        if (used == 0) return false;
+        if (used == length)
+        {
+            chunk.setAttachments(nullptr);
+            return true;
+        }
+        std::unique_ptr<ChunkAttachments> attachments(new ChunkAttachments());
+        if (!attachments->deserialize(data + used, length - used) || attachments->empty()) return false;
+        chunk.setAttachments(std::move(attachments));
+        return true;
+    }
+}
@@ -0,0 +1,49 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHUNKCODEC_H_
+#define CHUNKCODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "chunk.h"
+
+/*
+    Compact encoding of chunk blocks, shared by region files and the network.
+    Layout: [mode][palette size][palette...][body]
+      mode 0 (uniform):   palette has one entry, no body
+      mode 1 (packed):    palette indices, bit-packed in little-endian 64-bit words
+      mode 2 (runLength): varint (run length - 1) << paletteBits | palette index, in block index (z-major) order
+    Palette size and palette entries (raw block data) are varints.
+    Whole chunks may be followed by their serialized plugin attachments.
+*/
+namespace ChunkCodec
+{
+    // Append the encoded blocks of a chunk to `out`
+    void encode(const BlockData* blocks, std::vector<uint8_t>& out);
+    // Decode blocks of a chunk, return the bytes consumed, or 0 if the data is malformed
+    size_t decode(const uint8_t* data, size_t length, BlockData* blocks);
+    // Append the encoded blocks of a chunk to `out`, followed by the plugin attachments if there are any
+    void encode(const BlockData* blocks, const ChunkAttachments* attachments, std::vector<uint8_t>& out);
+    // Decode blocks and plugin attachments of a chunk, return false if the data is malformed
+    bool decode(const uint8_t* data, size_t length, Chunk& chunk);
+}
+
+#endif // !CHUNKCODEC_H_
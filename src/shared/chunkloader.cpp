@@ -17,6 +17,8 @@
 * along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <mutex>
+#include <vector>
 #include "chunkloader.h"
 #include "pluginmanager.h"
 
@@ -31,8 +33,59 @@ void NWAPICALL DefaultChunkGen(const Vec3i*, BlockData* blocks, int32_t daylight
 
 bool ChunkGeneratorLoaded = false;
 ChunkGenerator *ChunkGen = &DefaultChunkGen;
+ChunkBatchGenerator *ChunkBatchGen = nullptr;
+// DefaultChunkGen has no state
+int ChunkGenFlags = ChunkGenReentrant;
+PluginStats* ChunkGenOwner = nullptr;
+
+namespace
+{
+    // Serializes calls into generators which are not reentrant
+    std::mutex ChunkGenMutex;
+
+    // Positions and block pointers of a batch, reused by each thread
+    thread_local std::vector<Vec3i> BatchPositions;
+    thread_local std::vector<BlockData*> BatchBlocks;
+}
 
 void ChunkLoader::build(int daylightBrightness) const
 {
-    (*ChunkGen)(&m_chunk.getPosition(), m_chunk.getBlocks(), daylightBrightness);
+    Chunk* chunk = &m_chunk;
+    buildBatch(&chunk, 1, daylightBrightness);
+}
+
+void ChunkLoader::buildBatch(Chunk* const* chunks, size_t count, int daylightBrightness)
+{
+    BatchPositions.resize(count);
+    BatchBlocks.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        BatchPositions[i] = chunks[i]->getPosition();
+        BatchBlocks[i] = chunks[i]->getBlocks();
+    }
+    generate(BatchPositions.data(), BatchBlocks.data(), count, daylightBrightness);
+}
+
+void ChunkLoader::generate(const Vec3i* positions, BlockData* const* blocks, size_t count, int daylightBrightness)
+{
+    std::unique_lock<std::mutex> lock(ChunkGenMutex, std::defer_lock);
+    if (!(ChunkGenFlags & ChunkGenReentrant)) lock.lock();
+    PluginCall call(ChunkGenOwner, "the chunk generator");
+    if (ChunkBatchGen == nullptr || (count == 1 && ChunkGen != nullptr))
+    {
+        for (size_t i = 0; i < count; i++) (*ChunkGen)(positions + i, blocks[i], daylightBrightness);
+        return;
+    }
+    (*ChunkBatchGen)(positions, blocks, int(count), daylightBrightness);
+}
+
+void ChunkLoader::resetGenerator()
+{
+    // Waits for a running generator which is not reentrant
+    std::lock_guard<std::mutex> lock(ChunkGenMutex);
+    ChunkGeneratorLoaded = false;
+    ChunkGen = &DefaultChunkGen;
+    ChunkBatchGen = nullptr;
+    ChunkGenFlags = ChunkGenReentrant;
+    ChunkGenOwner = nullptr;
 }
@@ -22,11 +22,21 @@
 
 #include <common.h>
 #include <chunk.h>
+#include <pluginstats.h>
 
 using ChunkGenerator = void NWAPICALL(const Vec3i*, BlockData*, int);
+using ChunkBatchGenerator = void NWAPICALL(const Vec3i*, BlockData* const*, int, int);
+
+// Chunk generator capabilities, same as NW_CHUNKGEN_* in nwapi.h
+constexpr int ChunkGenReentrant = 1;
 
 extern bool ChunkGeneratorLoaded;
 extern ChunkGenerator *ChunkGen;
+// Batched entry of the generator, nullptr if it has none
+extern ChunkBatchGenerator *ChunkBatchGen;
+extern int ChunkGenFlags;
+// Plugin which registered the generator, nullptr for DefaultChunkGen
+extern PluginStats* ChunkGenOwner;
 
 class ChunkLoader
 {
@@ -43,6 +53,12 @@ public:
 
     // Build chunk
     void build(int DaylightBrightness) const;
+    // Build chunks in one generator call if the generator supports it
+    static void buildBatch(Chunk* const* chunks, size_t count, int daylightBrightness);
+    // Run the registered generator on block buffers (ChunkBlockCount blocks each)
+    static void generate(const Vec3i* positions, BlockData* const* blocks, size_t count, int daylightBrightness);
+    // Go back to DefaultChunkGen, before the plugin which registered the generator is unloaded
+    static void resetGenerator();
 };
 
 #endif // !CHUNKLOADER_H_
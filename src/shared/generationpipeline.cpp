@@ -0,0 +1,193 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <set>
+#include "chunkloader.h"
+#include "logger.h"
+#include "world.h"
+#include "generationpipeline.h"
+
+namespace
+{
+    // Non-negative remainder
+    int getPhase(int x, int period)
+    {
+        int res = x % period;
+        return res < 0 ? res + period : res;
+    }
+}
+
+BlockData GenerationContext::getBlock(const Vec3i& pos) const
+{
+    Chunk& center = getChunk();
+    return getNeighbour(World::getChunkPos(pos) - center.getPosition()).getBlock(World::getBlockPos(pos));
+}
+
+void GenerationContext::setBlock(const Vec3i& pos, BlockData block) const
+{
+    size_t index = getNeighbourIndex(World::getChunkPos(pos) - getChunk().getPosition());
+    if (m_states[index] != NeighbourState::Writable) m_lateWrites++;
+    m_neighbours[index]->setBlock(World::getBlockPos(pos), block);
+}
+
+GenerationPipeline::GenerationPipeline() : m_lateWrites(0)
+{
+    for (Stage& stage : m_stages) stage = { nullptr, nullptr, 0 };
+    m_stages[int(GenerationStage::Terrain)].batchFunc = ChunkLoader::buildBatch;
+}
+
+bool GenerationPipeline::setStage(GenerationStage stage, GenerationStageFunc func, int radius)
+{
+    if (radius < 0 || (stage == GenerationStage::Terrain && radius > 0))
+    {
+        errorstream << "Invalid radius " << radius << " for generation stage " << int(stage) << ", ignored";
+        return false;
+    }
+    m_stages[int(stage)] = { func, nullptr, radius };
+    return true;
+}
+
+void GenerationPipeline::setStage(GenerationStage stage, GenerationBatchFunc func)
+{
+    m_stages[int(stage)] = { nullptr, func, 0 };
+}
+
+void GenerationPipeline::generate(const std::vector<Vec3i>& chunks, ThreadPool& pool, int daylightBrightness)
+{
+    auto getStages = [this](const Vec3i& pos)
+    {
+        auto iter = m_chunks.find(pos);
+        return iter == m_chunks.end() ? 0 : iter->second.stages;
+    };
+
+    // Chunks which must run each stage, from the last stage back to the first:
+    // running stage s needs every chunk within its radius to have completed stage s - 1
+    std::vector<std::set<Vec3i>> runs(GenerationStageCount);
+    for (const Vec3i& pos : chunks)
+        if (getStages(pos) < GenerationStageCount) runs.back().insert(pos);
+    for (int s = GenerationStageCount - 1; s > 0; s--)
+    {
+        const int radius = m_stages[s].radius;
+        for (const Vec3i& pos : runs[s])
+            for (int x = -radius; x <= radius; x++)
+                for (int y = -radius; y <= radius; y++)
+                    for (int z = -radius; z <= radius; z++)
+                    {
+                        Vec3i neighbour = pos + Vec3i(x, y, z);
+                        if (getStages(neighbour) < s) runs[s - 1].insert(neighbour);
+                    }
+    }
+
+    for (const Vec3i& pos : runs.front())
+    {
+        Entry& entry = m_chunks[pos];
+        if (!entry.chunk)
+        {
+            entry.chunk.reset(new Chunk(pos));
+            entry.stages = 0;
+            entry.taken = m_taken.count(pos) != 0;
+        }
+    }
+    for (int s = 0; s < GenerationStageCount; s++)
+        runStage(s, std::vector<Vec3i>(runs[s].begin(), runs[s].end()), pool, daylightBrightness);
+}
+
+void GenerationPipeline::runStage(int stage, const std::vector<Vec3i>& chunks, ThreadPool& pool, int daylightBrightness)
+{
+    const Stage& info = m_stages[stage];
+    const int radius = info.radius, size = radius * 2 + 1;
+    if (info.batchFunc != nullptr && !chunks.empty())
+    {
+        std::vector<Chunk*> batch;
+        batch.reserve(chunks.size());
+        for (const Vec3i& pos : chunks) batch.push_back(m_chunks.at(pos).chunk.get());
+        const size_t share = (batch.size() + pool.getThreadCount() - 1) / pool.getThreadCount();
+        GenerationBatchFunc func = info.batchFunc;
+        // The pool may run other work (plugin jobs), only the tasks of the stage are waited for
+        TaskGroup group(pool);
+        for (size_t begin = 0; begin < batch.size(); begin += share)
+        {
+            const size_t count = std::min(share, batch.size() - begin);
+            group.post([func, &batch, begin, count, daylightBrightness]()
+            {
+                func(batch.data() + begin, count, daylightBrightness);
+            });
+        }
+        group.wait();
+    }
+    else if (info.func != nullptr)
+    {
+        // Chunks with the same phase are 2 * radius + 1 apart, so the chunks they may write never overlap.
+        // Phases run one after another, chunks in a phase run in parallel.
+        std::vector<std::vector<Vec3i>> phases(size * size * size);
+        for (const Vec3i& pos : chunks)
+            phases[(getPhase(pos.x, size) * size + getPhase(pos.y, size)) * size + getPhase(pos.z, size)].push_back(pos);
+        for (const auto& phase : phases)
+        {
+            if (phase.empty()) continue;
+            TaskGroup group(pool);
+            for (const Vec3i& pos : phase)
+            {
+                std::vector<Chunk*> neighbours;
+                std::vector<NeighbourState> states;
+                neighbours.reserve(size * size * size);
+                states.reserve(size * size * size);
+                const bool centerTaken = m_chunks.at(pos).taken;
+                for (int x = -radius; x <= radius; x++)
+                    for (int y = -radius; y <= radius; y++)
+                        for (int z = -radius; z <= radius; z++)
+                        {
+                            const Entry& entry = m_chunks.at(pos + Vec3i(x, y, z));
+                            neighbours.push_back(entry.chunk.get());
+                            // A chunk generated again only repeats the writes it made the first time
+                            if (entry.taken && !centerTaken) states.push_back(NeighbourState::Taken);
+                            else if (entry.stages > stage + 1) states.push_back(NeighbourState::Advanced);
+                            else states.push_back(NeighbourState::Writable);
+                        }
+                GenerationStageFunc func = info.func;
+                group.post([this, func, neighbours, states, radius, daylightBrightness]()
+                {
+                    GenerationContext context(neighbours.data(), states.data(), radius, daylightBrightness, m_lateWrites);
+                    func(context);
+                });
+            }
+            group.wait();
+        }
+        if (m_lateWrites != 0)
+        {
+            warningstream << m_lateWrites << " blocks written by generation stage " << stage
+                          << " went into chunks which were taken or completed later stages, they may be lost";
+            m_lateWriteCount += m_lateWrites;
+            m_lateWrites = 0;
+        }
+    }
+    for (const Vec3i& pos : chunks) m_chunks.at(pos).stages = stage + 1;
+}
+
+bool GenerationPipeline::take(Chunk& chunk)
+{
+    auto iter = m_chunks.find(chunk.getPosition());
+    if (iter == m_chunks.end() || iter->second.stages < GenerationStageCount) return false;
+    std::shared_ptr<Chunk> generated(std::move(iter->second.chunk));
+    m_chunks.erase(iter);
+    m_taken.insert(chunk.getPosition());
+    chunk.adoptBlocks(generated->getBlocks(), generated);
+    return true;
+}
@@ -0,0 +1,188 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GENERATIONPIPELINE_H_
+#define GENERATIONPIPELINE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+#include <boost/core/noncopyable.hpp>
+#include "chunk.h"
+#include "threadpool.h"
+
+/// Chunk generation stages, in the order they run
+enum class GenerationStage : int
+{
+    Terrain, Carving, Decoration, Lighting
+};
+
+constexpr int GenerationStageCount = 4;
+
+/// Whether writes into a neighbour end up in the generated chunk
+enum class NeighbourState : uint8_t
+{
+    Writable,
+    Taken, // Generated again after it was taken, writes into it are lost
+    Advanced // Already completed a later stage, which doesn't see the write
+};
+
+/// Chunks a stage function may access: the chunk being generated and its neighbours within the stage radius,
+/// which have all completed the previous stage
+class GenerationContext
+{
+public:
+    /// `states` are the NeighbourState of the neighbours, setBlock() counts writes into unwritable ones in `lateWrites`
+    GenerationContext(Chunk* const* neighbours, const NeighbourState* states, int radius, int daylightBrightness,
+                      std::atomic<size_t>& lateWrites)
+        : m_neighbours(neighbours), m_states(states), m_radius(radius), m_daylightBrightness(daylightBrightness),
+          m_lateWrites(lateWrites)
+    {
+    }
+
+    /// Get the chunk being generated
+    Chunk& getChunk() const
+    {
+        return getNeighbour(Vec3i(0, 0, 0));
+    }
+
+    /// Get a neighbour chunk by its offset (in chunks) from the chunk being generated.
+    /// Writes into neighbours should go through setBlock(), which checks that they are kept.
+    Chunk& getNeighbour(const Vec3i& offset) const
+    {
+        return *m_neighbours[getNeighbourIndex(offset)];
+    }
+
+    /// Get block data by world position, within the stage radius
+    BlockData getBlock(const Vec3i& pos) const;
+    /// Set block data by world position, within the stage radius
+    void setBlock(const Vec3i& pos, BlockData block) const;
+
+    int getRadius() const
+    {
+        return m_radius;
+    }
+
+    int getDaylightBrightness() const
+    {
+        return m_daylightBrightness;
+    }
+
+private:
+    /// (2 * radius + 1) ^ 3 chunks, x major
+    Chunk* const* m_neighbours;
+    /// States of m_neighbours
+    const NeighbourState* m_states;
+    int m_radius;
+    int m_daylightBrightness;
+    std::atomic<size_t>& m_lateWrites;
+
+    size_t getNeighbourIndex(const Vec3i& offset) const
+    {
+        assert(offset.chebyshevDistance(Vec3i(0, 0, 0)) <= m_radius);
+        const int size = m_radius * 2 + 1;
+        return size_t(((offset.x + m_radius) * size + offset.y + m_radius) * size + offset.z + m_radius);
+    }
+};
+
+using GenerationStageFunc = void(*)(GenerationContext& context);
+/// Stage function taking chunks in batches, for stages which don't access neighbours
+using GenerationBatchFunc = void(*)(Chunk* const* chunks, size_t count, int daylightBrightness);
+
+/// Staged chunk generation: terrain, carving, decoration, then lighting. Each stage declares the radius (in chunks)
+/// it reads and writes, and a chunk only runs a stage once all chunks within that radius completed the previous one.
+/// Neighbours generated only partially for that purpose are kept for later requests.
+/// Chunks of a stage run in parallel unless their radii overlap.
+class GenerationPipeline :boost::noncopyable
+{
+public:
+    /// The terrain stage runs the chunk generator in batches (see ChunkLoader), other stages do nothing
+    GenerationPipeline();
+
+    /// Set the function and neighbour radius of a stage, nullptr to skip it. Return false if the radius is invalid:
+    /// the terrain stage can't have neighbours, there is no earlier stage to prepare them.
+    bool setStage(GenerationStage stage, GenerationStageFunc func, int radius);
+    /// Set a batched function for a stage without neighbours, each worker gets a share of the chunks
+    void setStage(GenerationStage stage, GenerationBatchFunc func);
+
+    /// Get the neighbour radius of a stage
+    int getStageRadius(GenerationStage stage) const
+    {
+        return m_stages[int(stage)].radius;
+    }
+
+    /// Run all stages for `chunks` on the thread pool and wait for them
+    void generate(const std::vector<Vec3i>& chunks, ThreadPool& pool, int daylightBrightness);
+    /// Move the blocks of a fully generated chunk into `chunk` without copying them,
+    /// return false if it wasn't generated. A taken chunk is generated again if a later request needs it
+    /// as a neighbour, and what that request writes into it is not kept (such writes are logged).
+    bool take(Chunk& chunk);
+
+    /// Get the number of chunks held, partially generated ones included
+    size_t getChunkCount() const
+    {
+        return m_chunks.size();
+    }
+
+    /// Number of block writes into taken chunks or chunks past the writing stage
+    size_t getLateWriteCount() const
+    {
+        return m_lateWriteCount;
+    }
+
+    /// Drop all chunks held and forget the taken ones
+    void clear()
+    {
+        m_chunks.clear();
+        m_taken.clear();
+    }
+
+private:
+    struct Stage
+    {
+        GenerationStageFunc func;
+        GenerationBatchFunc batchFunc;
+        int radius;
+    };
+
+    struct Entry
+    {
+        std::unique_ptr<Chunk> chunk;
+        /// Number of completed stages
+        int stages;
+        /// Generated again after it was taken
+        bool taken;
+    };
+
+    Stage m_stages[GenerationStageCount];
+    std::map<Vec3i, Entry> m_chunks;
+    /// Positions of taken chunks
+    std::set<Vec3i> m_taken;
+    /// Writes into unwritable neighbours during the current stage
+    std::atomic<size_t> m_lateWrites;
+    size_t m_lateWriteCount = 0;
+
+    /// Run a stage on a set of chunks whose neighbours completed the previous stage
+    void runStage(int stage, const std::vector<Vec3i>& chunks, ThreadPool& pool, int daylightBrightness);
+};
+
+#endif // !GENERATIONPIPELINE_H_
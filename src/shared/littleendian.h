@@ -0,0 +1,55 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LITTLEENDIAN_H_
+#define LITTLEENDIAN_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Byte order of everything sent over the network, independent of the host and of alignment.
+// Compilers turn these loops into plain (unaligned) loads and stores on little-endian hosts.
+
+template <typename T>
+struct LittleEndianBits
+{
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "Only integers and enums have a byte order");
+    using Underlying = typename std::conditional<std::is_enum<T>::value, std::underlying_type<T>, std::common_type<T>>::type::type;
+    using Type = typename std::make_unsigned<Underlying>::type;
+};
+
+template <typename T>
+inline void storeLittleEndian(char* out, T value)
+{
+    using Bits = typename LittleEndianBits<T>::Type;
+    Bits bits = Bits(value);
+    for (size_t i = 0; i < sizeof(T); i++) out[i] = char(uint8_t(bits >> (8 * i)));
+}
+
+template <typename T>
+inline T loadLittleEndian(const char* in)
+{
+    using Bits = typename LittleEndianBits<T>::Type;
+    Bits bits = 0;
+    for (size_t i = 0; i < sizeof(T); i++) bits = Bits(bits | Bits(Bits(uint8_t(in[i])) << (8 * i)));
+    return T(bits);
+}
+
+#endif // !LITTLEENDIAN_H_
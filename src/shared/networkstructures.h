@@ -20,77 +20,92 @@
 #ifndef NETWORKSTRUCTURES_H_
 #define NETWORKSTRUCTURES_H_
 
-#include <string>
-#include <cstring>
 #include <cstdint>
-#include "packet.h"
+#include <tuple>
+#include <boost/utility/string_ref.hpp>
 #include "identifier.h"
+#include "packetschema.h"
 
-class NetworkStructure
+// Network structures are views: their strings point into the packet they are decoded from, or into the strings
+// they are made of. Their wire format is declared by fields(), see packetschema.h.
+// process() is implemented by each side (server and client), it returns false if the packet is refused.
+
+class LoginPacket :public PacketSchema<LoginPacket>
 {
 public:
-    virtual void process() = 0;
+    static constexpr Identifier identifier = Login;
 
-    virtual ~NetworkStructure()
+    LoginPacket() : m_version(0)
     {
     }
 
-    virtual Packet makePacket() = 0;
-};
-
-class LoginPacket :public NetworkStructure
-{
-public:
-    LoginPacket(std::string username, std::string password, uint16_t version)
+    LoginPacket(boost::string_ref username, boost::string_ref password, uint16_t version)
         : m_username(username), m_password(password), m_version(version)
     {
     }
 
-    Packet makePacket() override
+    static constexpr auto fields()
+    {
+        return std::make_tuple(&LoginPacket::m_username, &LoginPacket::m_password, &LoginPacket::m_version);
+    }
+
+    bool process() const;
+
+    boost::string_ref getUsername() const
     {
-        Packet p;
-        p.identifier = Identifier::Login;
-        p.length = m_username.length() + m_password.length() + sizeof(uint16_t) + sizeof(uint32_t) + 2;
-        p.data = std::unique_ptr<char[]>(new char[p.length]);
-        uint32_t lenUsername = m_username.length() + 1;
-        memcpy(p.data.get(), &lenUsername, sizeof(uint32_t));
-        strcpy(p.data.get() + sizeof(uint32_t), m_username.c_str());
-        strcpy(p.data.get() + sizeof(uint32_t) + m_username.length() + 1, m_password.c_str());
-        memcpy(p.data.get() + sizeof(uint32_t) + m_username.length() + m_password.length() + 2, &m_version, sizeof(uint16_t));
-        return p;
+        return m_username;
     }
 
-    void process() override;
+    boost::string_ref getPassword() const
+    {
+        return m_password;
+    }
+
+    uint16_t getVersion() const
+    {
+        return m_version;
+    }
 
 private:
-    std::string m_username;
-    std::string m_password;
+    boost::string_ref m_username;
+    boost::string_ref m_password;
     uint16_t m_version;
 };
 
-class ChatPacket : public NetworkStructure
+class ChatPacket :public PacketSchema<ChatPacket>
 {
 public:
-    ChatPacket(std::string userSend, std::string content)
+    static constexpr Identifier identifier = Chat;
+
+    ChatPacket()
+    {
+    }
+
+    ChatPacket(boost::string_ref userSend, boost::string_ref content)
         : m_userSend(userSend), m_content(content)
     {
     }
 
-    Packet makePacket() override
+    static constexpr auto fields()
     {
-        Packet p;
-        p.identifier = Identifier::Chat;
-        p.length = 0;
-        //        p.data = std::unique_ptr<char[]>(new char[p.length]);
-        return p;
+        return std::make_tuple(&ChatPacket::m_userSend, &ChatPacket::m_content);
     }
 
-    void process() override;
+    bool process() const;
 
+    boost::string_ref getUserSend() const
+    {
+        return m_userSend;
+    }
+
+    boost::string_ref getContent() const
+    {
+        return m_content;
+    }
 
 private:
-    std::string m_userSend;
-    std::string m_content;
+    boost::string_ref m_userSend;
+    boost::string_ref m_content;
 };
 
 #endif // !NETWORKSTRUCTURES_H_
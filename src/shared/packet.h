@@ -20,15 +20,39 @@
 #ifndef PACKET_H_
 #define PACKET_H_
 
-#include <memory>
 #include "identifier.h"
+#include "littleendian.h"
+#include "packetbuffer.h"
+
+/// Header of a packet on the wire, followed by `length` bytes of data
+struct PacketHeader
+{
+    uint32_t identifier;
+    uint32_t length;
+};
+
+/// Size of an encoded PacketHeader
+constexpr size_t PacketHeaderSize = 2 * sizeof(uint32_t);
+
+/// Write a header in wire order (little-endian)
+inline void encodePacketHeader(const PacketHeader& header, char* out)
+{
+    storeLittleEndian(out, header.identifier);
+    storeLittleEndian(out + sizeof(uint32_t), header.length);
+}
+
+/// Read a header in wire order
+inline PacketHeader decodePacketHeader(const char* in)
+{
+    return PacketHeader{ loadLittleEndian<uint32_t>(in), loadLittleEndian<uint32_t>(in + sizeof(uint32_t)) };
+}
 
 class Packet
 {
 public:
     Identifier identifier;
     uint32_t length;
-    std::shared_ptr<char> data;
+    PacketBuffer data; // `length` bytes, shared by copies of the packet
 };
 
 #endif // !PACKET_H_
@@ -0,0 +1,143 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+#include <new>
+#include <vector>
+#include "packetbuffer.h"
+
+namespace
+{
+    /// Block capacities: 64B, 256B, 1KB ... 1MB. Larger buffers are allocated and freed one by one.
+    constexpr size_t PoolCount = 8, SmallestBlock = 64;
+    /// Idle memory kept by each pool, at least MinIdleBlocks blocks
+    constexpr size_t MaxIdleBytes = 1 << 20, MinIdleBlocks = 4;
+
+    constexpr size_t getPoolCapacity(size_t pool)
+    {
+        return SmallestBlock << (pool * 2);
+    }
+
+    size_t getPool(size_t size)
+    {
+        size_t pool = 0;
+        while (pool < PoolCount && getPoolCapacity(pool) < size) pool++;
+        return pool;
+    }
+
+    struct Pool
+    {
+        std::mutex mutex;
+        std::vector<void*> idle;
+        size_t maxIdle;
+    };
+
+    class Pools
+    {
+    public:
+        Pools() : heapAllocations(0)
+        {
+            for (size_t i = 0; i < PoolCount; i++)
+            {
+                // Reserved up front, returning a block must not allocate
+                m_pools[i].maxIdle = std::max(MaxIdleBytes / getPoolCapacity(i), MinIdleBlocks);
+                m_pools[i].idle.reserve(m_pools[i].maxIdle);
+            }
+        }
+
+        ~Pools()
+        {
+            for (Pool& pool : m_pools)
+                for (void* block : pool.idle) ::operator delete(block);
+        }
+
+        Pool& operator[](size_t index)
+        {
+            return m_pools[index];
+        }
+
+        std::atomic<size_t> heapAllocations;
+
+    private:
+        Pool m_pools[PoolCount];
+    };
+
+    Pools& getPools()
+    {
+        static Pools pools;
+        return pools;
+    }
+}
+
+PacketBuffer::PacketBuffer(size_t size) : m_block(nullptr), m_size(size)
+{
+    if (size == 0) return;
+    const size_t index = getPool(size);
+    const size_t capacity = index < PoolCount ? getPoolCapacity(index) : size;
+    void* memory = nullptr;
+    if (index < PoolCount)
+    {
+        Pool& pool = getPools()[index];
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (!pool.idle.empty())
+        {
+            memory = pool.idle.back();
+            pool.idle.pop_back();
+        }
+    }
+    if (memory == nullptr)
+    {
+        memory = ::operator new(sizeof(Block) + capacity);
+        getPools().heapAllocations++;
+    }
+    m_block = new (memory) Block;
+    m_block->refs.store(1, std::memory_order_relaxed);
+    m_block->pool = uint32_t(index);
+    m_block->capacity = capacity;
+}
+
+void PacketBuffer::resize(size_t size) noexcept
+{
+    assert(size <= capacity());
+    m_size = size;
+}
+
+size_t PacketBuffer::getHeapAllocations()
+{
+    return getPools().heapAllocations;
+}
+
+void PacketBuffer::release(Block* block) noexcept
+{
+    const size_t index = block->pool;
+    block->~Block();
+    if (index < PoolCount)
+    {
+        Pool& pool = getPools()[index];
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (pool.idle.size() < pool.maxIdle)
+        {
+            pool.idle.push_back(block);
+            return;
+        }
+    }
+    ::operator delete(block);
+}
@@ -0,0 +1,122 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PACKETBUFFER_H_
+#define PACKETBUFFER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+/// Reference counted byte buffer for packet payloads, drawn from size-classed pools.
+/// Copies share the bytes, the memory goes back to its pool when the last copy is gone.
+class PacketBuffer
+{
+public:
+    PacketBuffer() noexcept : m_block(nullptr), m_size(0)
+    {
+    }
+
+    /// Get a buffer of `size` uninitialized bytes
+    explicit PacketBuffer(size_t size);
+
+    PacketBuffer(const PacketBuffer& rhs) noexcept : m_block(rhs.m_block), m_size(rhs.m_size)
+    {
+        if (m_block != nullptr) m_block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    PacketBuffer(PacketBuffer&& rhs) noexcept : m_block(rhs.m_block), m_size(rhs.m_size)
+    {
+        rhs.m_block = nullptr;
+        rhs.m_size = 0;
+    }
+
+    PacketBuffer& operator= (PacketBuffer rhs) noexcept
+    {
+        std::swap(m_block, rhs.m_block);
+        std::swap(m_size, rhs.m_size);
+        return *this;
+    }
+
+    ~PacketBuffer()
+    {
+        if (m_block != nullptr && m_block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) release(m_block);
+    }
+
+    char* data() noexcept
+    {
+        return m_block != nullptr ? m_block->getData() : nullptr;
+    }
+
+    const char* data() const noexcept
+    {
+        return m_block != nullptr ? m_block->getData() : nullptr;
+    }
+
+    size_t size() const noexcept
+    {
+        return m_size;
+    }
+
+    bool empty() const noexcept
+    {
+        return m_size == 0;
+    }
+
+    /// Get the number of bytes the buffer can hold without reallocating
+    size_t capacity() const noexcept
+    {
+        return m_block != nullptr ? m_block->capacity : 0;
+    }
+
+    /// Shrink or grow the buffer within its capacity, the bytes are kept
+    void resize(size_t size) noexcept;
+
+    /// Is this the only reference to the bytes
+    bool unique() const noexcept
+    {
+        return m_block == nullptr || m_block->refs.load(std::memory_order_acquire) == 1;
+    }
+
+    /// Get the number of blocks allocated from the heap so far (for tests and statistics)
+    static size_t getHeapAllocations();
+
+private:
+    struct alignas(16) Block
+    {
+        std::atomic<uint32_t> refs;
+        /// Index of the pool, or PoolCount for blocks too large to be pooled
+        uint32_t pool;
+        size_t capacity;
+
+        char* getData()
+        {
+            return reinterpret_cast<char*>(this + 1);
+        }
+    };
+
+    Block* m_block;
+    size_t m_size;
+
+    /// Return a block to its pool
+    static void release(Block* block) noexcept;
+};
+
+#endif // !PACKETBUFFER_H_
@@ -0,0 +1,104 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PACKETDISPATCH_H_
+#define PACKETDISPATCH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include "packet.h"
+#include "networkstructures.h"
+
+enum class DispatchResult
+{
+    handled, unknown, malformed
+};
+
+/// Packet types decoded by dispatchPacket()
+template <typename... Types>
+struct PacketTypeList
+{
+};
+
+using PacketTypes = PacketTypeList<LoginPacket, ChatPacket>;
+
+namespace PacketDispatch
+{
+    template <typename Handler>
+    using DecodeFunction = bool(const char* data, uint32_t length, Handler& handler);
+
+    /// Decode a packet on the stack and pass it to the handler
+    template <typename Type, typename Handler>
+    bool decodeAndHandle(const char* data, uint32_t length, Handler& handler)
+    {
+        Type packet;
+        if (!packet.decode(data, length)) return false;
+        handler(static_cast<const Type&>(packet));
+        return true;
+    }
+
+    template <typename Handler>
+    struct Entry
+    {
+        uint32_t identifier;
+        DecodeFunction<Handler>* decode;
+    };
+
+    constexpr bool hasDuplicates(const uint32_t* identifiers, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+            for (size_t j = i + 1; j < count; j++)
+                if (identifiers[i] == identifiers[j]) return true;
+        return false;
+    }
+
+    template <typename List, typename Handler>
+    struct Table;
+
+    /// Identifier to decoder and handler, built at compile time from the type list
+    template <typename... Types, typename Handler>
+    struct Table<PacketTypeList<Types...>, Handler>
+    {
+        static constexpr size_t Size = sizeof...(Types);
+        static constexpr uint32_t Identifiers[Size] = { uint32_t(Types::identifier)... };
+        static_assert(!hasDuplicates(Identifiers, Size), "Packet identifiers must be unique");
+        static constexpr Entry<Handler> Entries[Size] = { { uint32_t(Types::identifier), &decodeAndHandle<Types, Handler> }... };
+    };
+
+    template <typename... Types, typename Handler>
+    constexpr uint32_t Table<PacketTypeList<Types...>, Handler>::Identifiers[];
+
+    template <typename... Types, typename Handler>
+    constexpr Entry<Handler> Table<PacketTypeList<Types...>, Handler>::Entries[];
+}
+
+/// Decode a packet in place and call `handler(const Type&)` with it, without allocating.
+/// The decoded packet points into `data`, the handler must not keep it.
+template <typename Handler, typename List = PacketTypes>
+DispatchResult dispatchPacket(const PacketHeader& header, const char* data, Handler& handler)
+{
+    using Table = PacketDispatch::Table<List, Handler>;
+    for (const auto& entry : Table::Entries)
+        if (entry.identifier == header.identifier)
+            return entry.decode(data, header.length, handler) ? DispatchResult::handled : DispatchResult::malformed;
+    return DispatchResult::unknown;
+}
+
+#endif // !PACKETDISPATCH_H_
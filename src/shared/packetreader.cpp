@@ -0,0 +1,87 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include "packetreader.h"
+
+constexpr size_t PacketReader::ReceiveSize;
+
+PacketReader::PacketReader(uint32_t maxPacketLength)
+    : m_buffer(new char[ReceiveSize * 2]), m_capacity(ReceiveSize * 2), m_begin(0), m_end(0),
+      m_maxPacketLength(maxPacketLength), m_malformed(false)
+{
+}
+
+bool PacketReader::peekHeader(PacketHeader& header) const
+{
+    if (m_end - m_begin < PacketHeaderSize) return false;
+    header = decodePacketHeader(m_buffer.get() + m_begin);
+    return true;
+}
+
+void PacketReader::reallocate(size_t capacity)
+{
+    std::unique_ptr<char[]> buffer(new char[capacity]);
+    memcpy(buffer.get(), m_buffer.get() + m_begin, m_end - m_begin);
+    m_buffer = std::move(buffer);
+    m_capacity = capacity;
+    m_end -= m_begin;
+    m_begin = 0;
+}
+
+char* PacketReader::prepare(size_t& size)
+{
+    if (m_begin == m_end) m_begin = m_end = 0;
+    // A large packet was taken, the buffer goes back to its usual size
+    if (m_capacity > ReceiveSize * 2 && m_end - m_begin <= ReceiveSize) reallocate(ReceiveSize * 2);
+    if (m_capacity - m_end < ReceiveSize)
+    {
+        // Move the partial packet to the front
+        memmove(m_buffer.get(), m_buffer.get() + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+        // Only when the received part of a packet fills the buffer, so a header alone never makes it grow
+        if (m_capacity - m_end < ReceiveSize) reallocate(std::max(m_capacity * 2, m_end + ReceiveSize));
+    }
+    size = m_capacity - m_end;
+    return m_buffer.get() + m_end;
+}
+
+void PacketReader::commit(size_t size)
+{
+    assert(size <= m_capacity - m_end);
+    m_end += size;
+}
+
+bool PacketReader::next(PacketHeader& header, const char*& data)
+{
+    if (m_malformed || !peekHeader(header)) return false;
+    // Checked before anything is allocated for the packet
+    if (header.length > m_maxPacketLength)
+    {
+        m_malformed = true;
+        return false;
+    }
+    if (m_end - m_begin < PacketHeaderSize + header.length) return false;
+    data = m_buffer.get() + m_begin + PacketHeaderSize;
+    m_begin += PacketHeaderSize + header.length;
+    return true;
+}
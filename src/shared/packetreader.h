@@ -0,0 +1,93 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PACKETREADER_H_
+#define PACKETREADER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <boost/core/noncopyable.hpp>
+#include "packet.h"
+
+/// Largest packet payload accepted from the network
+constexpr uint32_t MaxPacketLength = 16 * 1024 * 1024;
+/// Largest packet payload accepted from a client which hasn't logged in
+constexpr uint32_t MaxLoginPacketLength = 4 * 1024;
+
+/// Splits a received byte stream into packets.
+/// Receive into the space given by prepare(), commit() the received bytes, then take the complete packets with next().
+/// The buffer grows with the bytes actually received, not with the length a header claims, and shrinks back
+/// once a large packet is taken.
+class PacketReader :boost::noncopyable
+{
+public:
+    /// Bytes asked for by each receive
+    static constexpr size_t ReceiveSize = 32 * 1024;
+
+    explicit PacketReader(uint32_t maxPacketLength = MaxPacketLength);
+
+    /// Get space for the next receive, at least ReceiveSize bytes. Invalidates the data returned by next().
+    char* prepare(size_t& size);
+    /// Add `size` received bytes (written to the space returned by prepare())
+    void commit(size_t size);
+
+    /// Take the next complete packet. `data` points into the receive buffer until the next prepare().
+    /// Return false if there is no complete packet yet, or the stream is malformed.
+    bool next(PacketHeader& header, const char*& data);
+
+    /// Change the largest accepted payload, applies to the packets which aren't taken yet
+    void setMaxPacketLength(uint32_t maxPacketLength)
+    {
+        m_maxPacketLength = maxPacketLength;
+    }
+
+    /// Has a packet header with an invalid length been received. The stream can't be read any further.
+    bool isMalformed() const
+    {
+        return m_malformed;
+    }
+
+    /// Get the number of received bytes which are not taken yet
+    size_t getBufferedBytes() const
+    {
+        return m_end - m_begin;
+    }
+
+    /// Get the size of the receive buffer
+    size_t getCapacity() const
+    {
+        return m_capacity;
+    }
+
+private:
+    std::unique_ptr<char[]> m_buffer;
+    size_t m_capacity;
+    /// Received bytes which are not taken yet are in [m_begin, m_end)
+    size_t m_begin, m_end;
+    uint32_t m_maxPacketLength;
+    bool m_malformed;
+
+    /// Read the header of the packet at m_begin, return false if it is not completely received
+    bool peekHeader(PacketHeader& header) const;
+    /// Move the received bytes into a new buffer of `capacity` bytes
+    void reallocate(size_t capacity);
+};
+
+#endif // !PACKETREADER_H_
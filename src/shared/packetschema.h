@@ -0,0 +1,210 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PACKETSCHEMA_H_
+#define PACKETSCHEMA_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <boost/utility/string_ref.hpp>
+#include "littleendian.h"
+#include "packet.h"
+#include "takedatahelper.h"
+
+/*
+    Packets declare their wire fields once, as a tuple of member pointers:
+        static constexpr auto fields() { return std::make_tuple(&Foo::m_a, &Foo::m_b); }
+    PacketSchema<Foo> generates the encoder, the decoder and the exact encoded size from it.
+    Field encodings (little-endian, no padding or alignment):
+        integers and enums: sizeof(T) bytes
+        strings (boost::string_ref): uint32_t length, then the bytes. Decoded strings point into the packet.
+*/
+
+namespace PacketSchemaDetail
+{
+    template <typename T, typename = void>
+    struct FieldCodec;
+
+    template <typename T>
+    struct FieldCodec<T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type>
+    {
+        static constexpr bool Fixed = true;
+
+        static constexpr size_t getSize(const T&)
+        {
+            return sizeof(T);
+        }
+
+        static void write(char*& out, T value)
+        {
+            storeLittleEndian(out, value);
+            out += sizeof(T);
+        }
+
+        static bool read(TakeDataHelper& in, T& value)
+        {
+            return in.take(value);
+        }
+    };
+
+    template <>
+    struct FieldCodec<boost::string_ref>
+    {
+        static constexpr bool Fixed = false;
+
+        static size_t getSize(const boost::string_ref& value)
+        {
+            return sizeof(uint32_t) + value.size();
+        }
+
+        static void write(char*& out, const boost::string_ref& value)
+        {
+            assert(value.size() <= UINT32_MAX);
+            storeLittleEndian(out, uint32_t(value.size()));
+            memcpy(out + sizeof(uint32_t), value.data(), value.size());
+            out += sizeof(uint32_t) + value.size();
+        }
+
+        static bool read(TakeDataHelper& in, boost::string_ref& value)
+        {
+            uint32_t length;
+            return in.take(length) && in.takeString(length, value);
+        }
+    };
+
+    template <typename Member>
+    struct MemberTraits;
+
+    template <typename Class, typename T>
+    struct MemberTraits<T Class::*>
+    {
+        using Type = T;
+        using Codec = FieldCodec<T>;
+    };
+
+    template <typename Type>
+    using Fields = decltype(Type::fields());
+
+    template <typename Type>
+    using Indices = std::make_index_sequence<std::tuple_size<Fields<Type>>::value>;
+
+    template <typename Type, size_t I>
+    using Codec = typename MemberTraits<typename std::tuple_element<I, Fields<Type>>::type>::Codec;
+
+    /// Size of the fixed-size fields, known at compile time
+    template <typename Type, size_t... I>
+    constexpr size_t getFixedSize(std::index_sequence<I...>)
+    {
+        size_t res = 0;
+        const bool fixed[] = { false, Codec<Type, I>::Fixed... };
+        const size_t sizes[] = { 0, sizeof(typename MemberTraits<typename std::tuple_element<I, Fields<Type>>::type>::Type)... };
+        for (size_t i = 0; i < sizeof...(I) + 1; i++)
+            if (fixed[i]) res += sizes[i];
+        return res;
+    }
+
+    template <typename Type, size_t... I>
+    size_t getEncodedSize(const Type& packet, std::index_sequence<I...>)
+    {
+        constexpr size_t fixedSize = getFixedSize<Type>(Indices<Type>());
+        constexpr Fields<Type> fields = Type::fields();
+        size_t res = fixedSize;
+        // Only the variable-size fields are measured at run time
+        const size_t sizes[] = { 0, (Codec<Type, I>::Fixed ? 0 : Codec<Type, I>::getSize(packet.*std::get<I>(fields)))... };
+        for (size_t size : sizes) res += size;
+        return res;
+    }
+
+    template <typename Type, size_t... I>
+    void encode(const Type& packet, char*& out, std::index_sequence<I...>)
+    {
+        constexpr Fields<Type> fields = Type::fields();
+        const int order[] = { 0, (Codec<Type, I>::write(out, packet.*std::get<I>(fields)), 0)... };
+        (void)order;
+    }
+
+    template <typename Type, size_t... I>
+    bool decode(Type& packet, TakeDataHelper& in, std::index_sequence<I...>)
+    {
+        constexpr Fields<Type> fields = Type::fields();
+        bool ok = true;
+        // Braced lists are evaluated in order, and nothing is read after the first failure
+        const int order[] = { 0, (ok = ok && Codec<Type, I>::read(in, packet.*std::get<I>(fields)), 0)... };
+        (void)order;
+        return ok;
+    }
+}
+
+/// Encoder and decoder of packet type `Derived`, generated from Derived::fields() (see above)
+template <typename Derived>
+class PacketSchema
+{
+public:
+    /// Get the exact size of the encoded packet data
+    size_t getEncodedSize() const
+    {
+        return PacketSchemaDetail::getEncodedSize(derived(), PacketSchemaDetail::Indices<Derived>());
+    }
+
+    /// Write the packet data, getEncodedSize() bytes
+    void encode(char* out) const
+    {
+        char* end = out;
+        PacketSchemaDetail::encode(derived(), end, PacketSchemaDetail::Indices<Derived>());
+        assert(size_t(end - out) == getEncodedSize());
+        (void)end;
+    }
+
+    /// Make a packet, with a single allocation of the exact size
+    Packet makePacket() const
+    {
+        Packet p;
+        p.identifier = Derived::identifier;
+        p.length = uint32_t(getEncodedSize());
+        p.data = PacketBuffer(p.length);
+        encode(p.data.data());
+        return p;
+    }
+
+    /// Decode packet data, return false if it is malformed (too short, or with trailing bytes).
+    /// Strings point into `data`.
+    bool decode(const char* data, uint32_t length)
+    {
+        TakeDataHelper in(data, length);
+        return PacketSchemaDetail::decode(derived(), in, PacketSchemaDetail::Indices<Derived>()) && in.getRemaining() == 0;
+    }
+
+private:
+    const Derived& derived() const
+    {
+        return static_cast<const Derived&>(*this);
+    }
+
+    Derived& derived()
+    {
+        return static_cast<Derived&>(*this);
+    }
+};
+
+#endif // !PACKETSCHEMA_H_
@@ -30,7 +30,9 @@ int Plugin::loadFrom(const std::string& filename)
     {
         m_lib.load(filename);
         init = m_lib.get<InitFunction>("init");
+        PluginCall call(m_stats, "init()");
         m_data = init();
+        if (m_data != nullptr) m_stats->name = m_data->internalName;
     }
     catch (std::exception& e)
     {
@@ -45,11 +47,16 @@ void Plugin::unload()
 {
     if (m_status != 0) return;
     m_status = -1;
+    // Jobs of the plugin must not run once its code is gone
+    if (m_tasks != nullptr) m_tasks->cancelAll(m_stats);
     UnloadFunction* unload = nullptr;
     try
     {
         unload = m_lib.get<UnloadFunction>("unload");
-        unload();
+        {
+            PluginCall call(m_stats, "unload()");
+            unload();
+        }
         m_lib.unload();
     }
     catch (std::exception& e)
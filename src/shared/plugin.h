@@ -27,6 +27,8 @@
 #include "common.h"
 #include "vec3.h"
 #include "blockdata.h"
+#include "pluginstats.h"
+#include "plugintasks.h"
 
 struct PluginData
 {
@@ -39,12 +41,15 @@ struct PluginData
 class Plugin
 {
 public:
-    explicit Plugin(const std::string& filename) : m_status(-1)
+    // Calls into the plugin are accounted to `stats`, its `tasks` are cancelled when it unloads
+    Plugin(const std::string& filename, PluginStats* stats, PluginTasks* tasks = nullptr)
+        : m_stats(stats), m_tasks(tasks), m_status(-1)
     {
         loadFrom(filename);
     }
 
-    Plugin(Plugin&& rhs) : m_lib(std::move(rhs.m_lib)), m_data(rhs.m_data), m_status(rhs.m_status)
+    Plugin(Plugin&& rhs)
+        : m_lib(std::move(rhs.m_lib)), m_data(rhs.m_data), m_stats(rhs.m_stats), m_tasks(rhs.m_tasks), m_status(rhs.m_status)
     {
         rhs.m_data = nullptr;
         rhs.m_status = -1;
@@ -87,6 +92,10 @@ private:
     boost::dll::shared_library m_lib;
     // Plugin Data
     const PluginData* m_data;
+    // Time spent in this plugin
+    PluginStats* m_stats;
+    // Jobs scheduled by plugins
+    PluginTasks* m_tasks;
     // Load status
     int m_status = -1;
 };
@@ -17,6 +17,7 @@
 * along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include "pluginapi.h"
 
 namespace PluginAPI
@@ -28,15 +29,15 @@ namespace PluginAPI
 
     BlockData convertBlockData(const NWblockdata& src)
     {
-        return BlockData(src.id, src.brightness, src.state);
+        BlockData res;
+        memcpy(static_cast<void*>(&res), &src, sizeof(res));
+        return res;
     }
 
     NWblockdata convertBlockData(const BlockData& src)
     {
         NWblockdata res;
-        res.id = src.getID();
-        res.brightness = src.getBrightness();
-        res.state = src.getState();
+        memcpy(&res, static_cast<const void*>(&src), sizeof(res));
         return res;
     }
 
@@ -44,6 +45,26 @@ namespace PluginAPI
     {
         return BlockType(src.blockname, src.solid, src.translucent, src.opaque, src.explodePower, src.hardness);
     }
+
+    // Block counts of bulk edits saturate, boxes can hold more blocks than int32_t
+    int32_t clampCount(size_t count)
+    {
+        return int32_t(std::min(count, size_t(INT32_MAX)));
+    }
+
+    bool checkBox(const NWworld* world, const NWvec3i* min, const NWvec3i* max, const char* what)
+    {
+        if (world != nullptr && min != nullptr && max != nullptr) return true;
+        warningstream << "Ignoring " << what << ", the world or the box is null";
+        return false;
+    }
+
+    bool checkBuffer(const NWblockdata* buffer, const char* what)
+    {
+        if (buffer != nullptr) return true;
+        warningstream << "Ignoring " << what << ", the region buffer is null";
+        return false;
+    }
 }
 
 // Export APIs for plugins
@@ -53,15 +74,132 @@ extern "C"
     // Please don't put `using namespace` in header files (This is a source file 2333)
     using namespace PluginAPI;
 
+    NWAPIEXPORT NWworld* NWAPICALL nwGetCurrentWorld()
+    {
+        return CurrWorld;
+    }
+
+    NWAPIEXPORT NWblockdata NWAPICALL nwWorldGetBlock(NWworld* world, const NWvec3i* pos)
+    {
+        return convertBlockData(world->getBlock(*pos));
+    }
+
+    NWAPIEXPORT int32_t NWAPICALL nwWorldSetBlock(NWworld* world, const NWvec3i* pos, NWblockdata block)
+    {
+        world->setBlock(*pos, convertBlockData(block));
+        return 0;
+    }
+
+    NWAPIEXPORT int32_t NWAPICALL nwWorldGetBlocks(NWworld* world, const NWvec3i* pos, int32_t count, NWblockdata* blocks)
+    {
+        if (count < 0 || (count > 0 && (pos == nullptr || blocks == nullptr)))
+        {
+            warningstream << "Ignoring block query of " << count << " positions, the count or the arrays are invalid";
+            return -1;
+        }
+        return int32_t(world->getBlocks(pos, size_t(count), convertBlockData(blocks)));
+    }
+
     NWAPIEXPORT NWblockdata NWAPICALL nwGetBlock(const NWvec3i* pos)
     {
-        return convertBlockData(CurrWorld->getBlock(*pos));
+        return nwWorldGetBlock(CurrWorld, pos);
     }
 
     NWAPIEXPORT int32_t NWAPICALL nwSetBlock(const NWvec3i* pos, NWblockdata block)
     {
-        CurrWorld->setBlock(*pos, convertBlockData(block));
-        return 0;
+        return nwWorldSetBlock(CurrWorld, pos, block);
+    }
+
+    NWAPIEXPORT int32_t NWAPICALL nwSubscribe(int32_t event, NWeventhandler* const handler, void* userData)
+    {
+        int32_t res = Plugins->getEvents().subscribe(event, handler, userData);
+        if (res < 0) warningstream << "Ignoring invalid subscription to event " << event;
+        return res;
+    }
+
+    NWAPIEXPORT int32_t NWAPICALL nwUnsubscribe(int32_t subscription)
+    {
+        return Plugins->getEvents().unsubscribe(subscription) ? 0 : 1;
+    }
+
+    NWAPIEXPORT int32_t NWAPICALL nwScheduleAsync(NWtaskfunction* const job, NWtaskfunction* const completion, void* userData)
+    {
+        int32_t res = Plugins->getTasks().scheduleAsync(job, completion, userData);
+        if (res < 0) warningstream << "Ignoring async job, " << (job == nullptr ? "the job is null" : "no worker threads");
+        return res;
+    }
+
+    NWAPIEXPORT int32_t NWAPICALL nwScheduleOnTick(NWtaskfunction* const job, int32_t delay, void* userData)
+    {
+        int32_t res = Plugins->getTasks().scheduleOnTick(job, delay, userData);
+        if (res < 0) warningstream << "Ignoring tick job, the job is null";
+        return res;
+    }
+
+    NWAPIEXPORT int32_t NWAPICALL nwCancelTask(int32_t task)
+    {
+        return Plugins->getTasks().cancel(task) ? 0 : 1;
+    }
+
+    NWAPIEXPORT int32_t NWAPICALL nwFillColumn(NWworld* world, int32_t x, int32_t z, int32_t bottom, int32_t top, NWblockdata block)
+    {
+        if (world == nullptr)
+        {
+            warningstream << "Ignoring column fill, the world is null";
+            return -1;
+        }
+        return clampCount(world->fillBlocks(Vec3i(x, bottom, z), Vec3i(x, top, z), convertBlockData(block)));
+    }
+
+    NWAPIEXPORT int32_t NWAPICALL nwFillBox(NWworld* world, const NWvec3i* min, const NWvec3i* max, NWblockdata block)
+    {
+        if (!checkBox(world, min, max, "box fill")) return -1;
+        return clampCount(world->fillBlocks(*min, *max, convertBlockData(block)));
+    }
+
+    NWAPIEXPORT int32_t NWAPICALL nwReplaceBlocks(NWworld* world, const NWvec3i* min, const NWvec3i* max, int32_t fromID,
+                                                  NWblockdata block)
+    {
+        if (!checkBox(world, min, max, "block replacement")) return -1;
+        return clampCount(world->replaceBlocks(*min, *max, fromID, convertBlockData(block)));
+    }
+
+    NWAPIEXPORT int32_t NWAPICALL nwCopyRegionIn(NWworld* world, const NWvec3i* min, const NWvec3i* max, const NWblockdata* src)
+    {
+        if (!checkBox(world, min, max, "region copy") || !checkBuffer(src, "region copy")) return -1;
+        return clampCount(world->copyBlocksIn(*min, *max, convertBlockData(src)));
+    }
+
+    NWAPIEXPORT int32_t NWAPICALL nwCopyRegionOut(NWworld* world, const NWvec3i* min, const NWvec3i* max, NWblockdata* dst)
+    {
+        if (!checkBox(world, min, max, "region copy") || !checkBuffer(dst, "region copy")) return -1;
+        return clampCount(world->copyBlocksOut(*min, *max, convertBlockData(dst)));
+    }
+
+    NWAPIEXPORT uint32_t NWAPICALL nwGetPluginID(const char* internalName)
+    {
+        return getAttachmentPluginID(internalName);
+    }
+
+    NWAPIEXPORT int32_t NWAPICALL nwSetAttachment(NWworld* world, const NWvec3i* pos, uint32_t pluginID, const void* data,
+                                                  int32_t length)
+    {
+        if (length < 0 || size_t(length) > MaxAttachmentLength || (data == nullptr && length > 0))
+        {
+            warningstream << "Ignoring attachment of " << length << " bytes, the length or the data is invalid";
+            return 2;
+        }
+        return world->setAttachment(*pos, pluginID, static_cast<const uint8_t*>(data), size_t(length)) ? 0 : 1;
+    }
+
+    NWAPIEXPORT int32_t NWAPICALL nwGetAttachment(NWworld* world, const NWvec3i* pos, uint32_t pluginID, void* buffer,
+                                                  int32_t bufferSize)
+    {
+        if (bufferSize < 0 || (buffer == nullptr && bufferSize > 0)) return -2;
+        const std::vector<uint8_t>* data = world->getAttachment(*pos, pluginID);
+        if (data == nullptr) return -1;
+        memcpy(buffer, data->data(), std::min(data->size(), size_t(bufferSize)));
+        return int32_t(data->size());
     }
 
     NWAPIEXPORT int32_t NWAPICALL nwRegisterBlock(const NWblocktype* block)
@@ -69,9 +207,14 @@ extern "C"
         return Blocks->registerBlock(convertBlockType(*block));
     }
 
-    NWAPIEXPORT int32_t NWAPICALL nwRegisterChunkGenerator(NWchunkgenerator* const generator)
+    NWAPIEXPORT int32_t NWAPICALL nwRegisterChunkGeneratorEx(NWchunkgenerator* const generator,
+                                                            NWchunkbatchgenerator* const batchGenerator, int32_t flags)
     {
-        /*
+        if (generator == nullptr && batchGenerator == nullptr)
+        {
+            warningstream << "Ignoring empty chunk generator";
+            return 1;
+        }
         if (ChunkGeneratorLoaded)
         {
             warningstream << "Ignoring multiple chunk generator";
@@ -79,11 +222,20 @@ extern "C"
         }
         ChunkGeneratorLoaded = true;
         ChunkGen = generator;
-        infostream << "Registered chunk generator";
-        */
+        ChunkBatchGen = batchGenerator;
+        ChunkGenFlags = flags;
+        ChunkGenOwner = PluginCall::getCurrent();
+        infostream << "Registered chunk generator" << (batchGenerator != nullptr ? " (batched)" : "")
+                   << ((flags & ChunkGenReentrant) ? " (reentrant)" : "");
         return 0;
     }
 
+    NWAPIEXPORT int32_t NWAPICALL nwRegisterChunkGenerator(NWchunkgenerator* const generator)
+    {
+        // Generators registered without flags may keep state between calls, so they are not run concurrently
+        return nwRegisterChunkGeneratorEx(generator, nullptr, 0);
+    }
+
     NWAPIEXPORT void NWAPICALL nwLog(char* str, Logger::Level level)
     {
         Logger("", "", 0, level) << str;
@@ -20,6 +20,7 @@
 #ifndef PLUGINAPI_H_
 #define PLUGINAPI_H_
 
+#include <type_traits>
 #include "common.h"
 #include "logger.h"
 #include "vec3.h"
@@ -27,6 +28,7 @@
 #include "blocktype.h"
 #include "blockmanager.h"
 #include "world.h"
+#include "pluginmanager.h"
 #include <chunkloader.h>
 
 namespace PluginAPI
@@ -49,6 +51,7 @@ namespace PluginAPI
 
     using NWvec3i = Vec3i;
 
+    // Same bitfields as BlockData: blocks are reinterpreted, not converted
     struct NWblockdata
     {
         uint32_t id : 12;
@@ -56,6 +59,20 @@ namespace PluginAPI
         uint32_t state : 16;
     };
 
+    static_assert(sizeof(NWblockdata) == sizeof(BlockData) && alignof(NWblockdata) == alignof(BlockData),
+                  "NWblockdata and BlockData must have the same layout");
+    static_assert(std::is_trivially_copyable<NWblockdata>::value && std::is_trivially_copyable<BlockData>::value,
+                  "Blocks must be trivially copyable to cross the plugin boundary");
+
+    using NWworld = World;
+
+    using NWblockchange = BlockChange;
+    static_assert(sizeof(BlockChange) == sizeof(Vec3i) + sizeof(BlockData), "BlockChange must match NWblockchange");
+
+    using NWeventhandler = PluginEventHandler;
+
+    using NWtaskfunction = PluginTaskFunction;
+
     struct NWblocktype
     {
         char* blockname = nullptr;
@@ -67,12 +84,26 @@ namespace PluginAPI
     };
 
     using NWchunkgenerator = ChunkGenerator;
+    using NWchunkbatchgenerator = ChunkBatchGenerator;
 
     // Conversions between plugin structures and NEWorld structures
     // This is used when structure definitions in NEWorld and in Plugin API are different
 
+    // Blocks only change their type (a copy of 32 bits)
     BlockData convertBlockData(const NWblockdata& src);
     NWblockdata convertBlockData(const BlockData& src);
+
+    // Block arrays are shared in place
+    inline BlockData* convertBlockData(NWblockdata* src)
+    {
+        return reinterpret_cast<BlockData*>(src);
+    }
+
+    inline const BlockData* convertBlockData(const NWblockdata* src)
+    {
+        return reinterpret_cast<const BlockData*>(src);
+    }
+
     BlockType convertBlockType(const NWblocktype& src);
 
 }
@@ -0,0 +1,130 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include "pluginevents.h"
+
+int32_t PluginEvents::subscribe(int event, PluginEventHandler* handler, void* userData)
+{
+    if (event < 0 || event >= PluginEventCount || handler == nullptr) return -1;
+    Subscriber subscriber;
+    subscriber.handler = handler;
+    subscriber.userData = userData;
+    subscriber.id = m_nextID++;
+    subscriber.owner = PluginCall::getCurrent();
+    // Subscribers added by a handler get the next events, dispatch() only visits the ones it started with
+    m_subscribers[event].push_back(subscriber);
+    updateSubscribed(event);
+    return subscriber.id;
+}
+
+bool PluginEvents::unsubscribe(int32_t id)
+{
+    for (int event = 0; event < PluginEventCount; event++)
+    {
+        std::vector<Subscriber>& subscribers = m_subscribers[event];
+        auto iter = std::find_if(subscribers.begin(), subscribers.end(), [id](const Subscriber& subscriber)
+        {
+            return subscriber.id == id && subscriber.handler != nullptr;
+        });
+        if (iter == subscribers.end()) continue;
+        if (m_dispatching > 0)
+        {
+            // The table is being walked, erase it afterwards
+            iter->handler = nullptr;
+            m_removed = true;
+        }
+        else
+        {
+            subscribers.erase(iter);
+            updateSubscribed(event);
+        }
+        return true;
+    }
+    return false;
+}
+
+void PluginEvents::clear()
+{
+    assert(m_dispatching == 0);
+    for (int event = 0; event < PluginEventCount; event++)
+    {
+        m_subscribers[event].clear();
+        updateSubscribed(event);
+    }
+}
+
+void PluginEvents::dispatch(PluginEvent event, World* world, const void* events, size_t count)
+{
+    assert(count <= size_t(std::numeric_limits<int32_t>::max()));
+    std::vector<Subscriber>& subscribers = m_subscribers[int(event)];
+    m_dispatching++;
+    for (size_t i = 0, size = subscribers.size(); i < size; i++)
+    {
+        // Handlers may subscribe, which can move the table
+        const Subscriber subscriber = subscribers[i];
+        if (subscriber.handler == nullptr) continue;
+        PluginCall call(subscriber.owner, "an event handler");
+        (*subscriber.handler)(world, events, int32_t(count), subscriber.userData);
+    }
+    if (--m_dispatching == 0 && m_removed)
+    {
+        m_removed = false;
+        for (int i = 0; i < PluginEventCount; i++)
+        {
+            std::vector<Subscriber>& table = m_subscribers[i];
+            table.erase(std::remove_if(table.begin(), table.end(), [](const Subscriber& subscriber)
+            {
+                return subscriber.handler == nullptr;
+            }), table.end());
+            updateSubscribed(i);
+        }
+    }
+}
+
+void PluginEvents::tick()
+{
+    const int64_t tick = m_tick++;
+    if (hasSubscribers(PluginEvent::Tick)) dispatch(PluginEvent::Tick, nullptr, &tick, 1);
+}
+
+void PluginEventQueue::flush(World* world)
+{
+    // Swapped out first: handlers may change blocks, those events wait for the next flush
+    take(m_changedBlocks, m_dispatchedBlocks);
+    if (!m_dispatchedBlocks.empty())
+    {
+        m_events.dispatch(PluginEvent::BlockChanged, world, m_dispatchedBlocks.data(), m_dispatchedBlocks.size());
+        m_dispatchedBlocks.clear();
+    }
+    take(m_loadedChunks, m_dispatchedChunks);
+    if (!m_dispatchedChunks.empty())
+    {
+        m_events.dispatch(PluginEvent::ChunkLoaded, world, m_dispatchedChunks.data(), m_dispatchedChunks.size());
+        m_dispatchedChunks.clear();
+    }
+    take(m_unloadedChunks, m_dispatchedChunks);
+    if (!m_dispatchedChunks.empty())
+    {
+        m_events.dispatch(PluginEvent::ChunkUnloaded, world, m_dispatchedChunks.data(), m_dispatchedChunks.size());
+        m_dispatchedChunks.clear();
+    }
+}
@@ -0,0 +1,177 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PLUGINEVENTS_H_
+#define PLUGINEVENTS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <boost/core/noncopyable.hpp>
+#include "common.h"
+#include "vec3.h"
+#include "blockdata.h"
+#include "pluginstats.h"
+
+class World;
+
+/// Plugin events, same as NW_EVENT_* in nwapi.h
+enum class PluginEvent
+{
+    BlockChanged, ChunkLoaded, ChunkUnloaded, Tick
+};
+
+constexpr int PluginEventCount = 4;
+
+/// Event handler: (world, events, event count, user data). Events are BlockChange for BlockChanged,
+/// chunk positions (Vec3i) for ChunkLoaded and ChunkUnloaded, and the tick number (int64_t) for Tick.
+using PluginEventHandler = void NWAPICALL(World*, const void*, int32_t, void*);
+
+/// Block changed event, same layout as NWblockchange
+struct BlockChange
+{
+    Vec3i pos;
+    BlockData block;
+};
+
+/// Event subscriptions of plugins. Handlers sit in a flat table per event, and get all events of a tick in one call.
+/// Only the thread running the update loop may subscribe and dispatch, hasSubscribers() may be called from any thread.
+class PluginEvents :boost::noncopyable
+{
+public:
+    PluginEvents() : m_nextID(0), m_tick(0), m_dispatching(0), m_removed(false)
+    {
+        for (std::atomic<bool>& subscribed : m_subscribed) subscribed = false;
+    }
+
+    /// Subscribe to an event (PluginEvent), return the subscription ID, or -1 if the event or the handler is invalid
+    int32_t subscribe(int event, PluginEventHandler* handler, void* userData);
+    /// Cancel a subscription, return false if there is no such subscription
+    bool unsubscribe(int32_t id);
+    /// Cancel all subscriptions
+    void clear();
+
+    /// Is anyone subscribed to the event
+    bool hasSubscribers(PluginEvent event) const
+    {
+        return m_subscribed[int(event)].load(std::memory_order_relaxed);
+    }
+
+    /// Deliver events to all subscribers, one call each
+    void dispatch(PluginEvent event, World* world, const void* events, size_t count);
+    /// Deliver the tick event and advance the tick number
+    void tick();
+
+    /// Get the number of the next tick
+    int64_t getTick() const
+    {
+        return m_tick;
+    }
+
+private:
+    struct Subscriber
+    {
+        PluginEventHandler* handler; // nullptr when cancelled during a dispatch
+        void* userData;
+        int32_t id;
+        // Plugin which subscribed, nullptr for NEWorld itself
+        PluginStats* owner;
+    };
+
+    std::vector<Subscriber> m_subscribers[PluginEventCount];
+    /// Whether m_subscribers isn't empty, readable by the threads recording events
+    std::atomic<bool> m_subscribed[PluginEventCount];
+    int32_t m_nextID;
+    int64_t m_tick;
+    /// Nesting depth of dispatch(), cancelled subscriptions are erased when it drops to zero
+    int m_dispatching;
+    bool m_removed;
+
+    void updateSubscribed(int event)
+    {
+        m_subscribed[event].store(!m_subscribers[event].empty(), std::memory_order_relaxed);
+    }
+};
+
+/// Events of a world waiting for the end of the tick. Events without subscribers are not recorded.
+/// Events may be recorded from any thread, flush() runs on the thread running the update loop.
+class PluginEventQueue :boost::noncopyable
+{
+public:
+    explicit PluginEventQueue(PluginEvents& events) : m_events(events)
+    {
+    }
+
+    /// Should block changes be recorded
+    bool wantsBlockChanges() const
+    {
+        return m_events.hasSubscribers(PluginEvent::BlockChanged);
+    }
+
+    void blockChanged(const Vec3i& pos, BlockData block)
+    {
+        if (!wantsBlockChanges()) return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_changedBlocks.push_back(BlockChange{ pos, block });
+    }
+
+    /// Record block changes with one lock
+    template <class Iterator>
+    void blocksChanged(Iterator begin, Iterator end)
+    {
+        if (!wantsBlockChanges()) return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (; begin != end; ++begin) m_changedBlocks.push_back(BlockChange{ begin->first, begin->second });
+    }
+
+    void chunkLoaded(const Vec3i& chunkPos)
+    {
+        if (!m_events.hasSubscribers(PluginEvent::ChunkLoaded)) return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_loadedChunks.push_back(chunkPos);
+    }
+
+    void chunkUnloaded(const Vec3i& chunkPos)
+    {
+        if (!m_events.hasSubscribers(PluginEvent::ChunkUnloaded)) return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_unloadedChunks.push_back(chunkPos);
+    }
+
+    /// Deliver the queued events. Events raised by the handlers are delivered by the next flush.
+    void flush(World* world);
+
+private:
+    PluginEvents& m_events;
+    /// Guards the recorded events, the dispatched ones belong to flush()
+    std::mutex m_mutex;
+    std::vector<BlockChange> m_changedBlocks, m_dispatchedBlocks;
+    std::vector<Vec3i> m_loadedChunks, m_unloadedChunks, m_dispatchedChunks;
+
+    /// Move recorded events into an empty dispatch buffer
+    template <class T>
+    void take(std::vector<T>& recorded, std::vector<T>& dispatched)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        dispatched.swap(recorded);
+    }
+};
+
+#endif // !PLUGINEVENTS_H_
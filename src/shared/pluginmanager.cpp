@@ -21,16 +21,19 @@
 #include <boost/filesystem/path.hpp>
 #include "common.h"
 #include "utils.h"
+#include "chunkloader.h"
 #include "pluginmanager.h"
 #include "logger.h"
 
 void PluginManager::loadPlugin(const std::string& filename)
 {
-    m_plugins.emplace_back(Plugin(filename));
+    m_stats.emplace_back(new PluginStats(filename));
+    m_plugins.emplace_back(Plugin(filename, m_stats.back().get(), &m_tasks));
     const Plugin& plugin = m_plugins[m_plugins.size() - 1];
     if (!plugin.isLoaded())
     {
         m_plugins.pop_back();
+        m_stats.pop_back();
         warningstream << "Failed to load plugin from \"" << filename << "\", skipping";
         return;
     }
@@ -60,5 +63,9 @@ void PluginManager::loadPlugins(const std::string& base)
 
 void PluginManager::unloadPlugins()
 {
+    // Handlers and the chunk generator must not be called once their plugins are gone
+    m_events.clear();
+    if (ChunkGeneratorLoaded) ChunkLoader::resetGenerator();
     m_plugins.clear();
+    m_stats.clear();
 }
@@ -20,10 +20,12 @@
 #ifndef PLUGINMANAGER_H_
 #define PLUGINMANAGER_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 #include <boost/dll/shared_library.hpp>
 #include "plugin.h"
+#include "pluginevents.h"
 
 // Plugin system
 class PluginManager
@@ -41,8 +43,31 @@ public:
     // Unload plugins
     void unloadPlugins();
 
+    // Get time spent in each loaded plugin
+    const std::vector<std::unique_ptr<PluginStats>>& getStats() const
+    {
+        return m_stats;
+    }
+
+    // Get event subscriptions of plugins
+    PluginEvents& getEvents()
+    {
+        return m_events;
+    }
+
+    // Get jobs scheduled by plugins
+    PluginTasks& getTasks()
+    {
+        return m_tasks;
+    }
+
 private:
+    // Before m_plugins, plugins cancel their jobs when they unload
+    PluginTasks m_tasks;
     std::vector<Plugin> m_plugins;
+    // Same order as m_plugins
+    std::vector<std::unique_ptr<PluginStats>> m_stats;
+    PluginEvents m_events;
 };
 
 #endif // !PLUGINMANAGER_H_
@@ -0,0 +1,62 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pluginstats.h"
+#include "logger.h"
+
+namespace
+{
+    thread_local PluginStats* CurrentPlugin = nullptr;
+    std::atomic<int64_t> CallBudget(std::chrono::nanoseconds(std::chrono::milliseconds(DefaultPluginCallBudgetMs)).count());
+}
+
+PluginCall::PluginCall(PluginStats* plugin, const char* what)
+    : m_plugin(plugin), m_previous(CurrentPlugin), m_what(what)
+{
+    if (m_plugin == nullptr) return;
+    CurrentPlugin = m_plugin;
+    m_begin = Clock::now();
+}
+
+PluginCall::~PluginCall()
+{
+    if (m_plugin == nullptr) return;
+    uint64_t elapsed = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_begin).count());
+    CurrentPlugin = m_previous;
+    m_plugin->calls++;
+    m_plugin->nanoseconds += elapsed;
+    uint64_t max = m_plugin->maxNanoseconds;
+    while (elapsed > max && !m_plugin->maxNanoseconds.compare_exchange_weak(max, elapsed));
+    if (int64_t(elapsed) > CallBudget)
+    {
+        m_plugin->slowCalls++;
+        warningstream << "Plugin " << m_plugin->name << " took " << elapsed / 1000000.0 << "ms in " << m_what
+                      << ", the budget is " << CallBudget / 1000000.0 << "ms";
+    }
+}
+
+PluginStats* PluginCall::getCurrent()
+{
+    return CurrentPlugin;
+}
+
+void PluginCall::setBudget(std::chrono::nanoseconds budget)
+{
+    CallBudget = budget.count();
+}
@@ -0,0 +1,73 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PLUGINSTATS_H_
+#define PLUGINSTATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <boost/core/noncopyable.hpp>
+
+/// Default time a single call into a plugin may take before it is reported as slow
+constexpr int DefaultPluginCallBudgetMs = 50;
+
+/// Wall time and calls spent in one plugin, updated from any thread
+struct PluginStats :boost::noncopyable
+{
+    explicit PluginStats(const std::string& name_) : name(name_), calls(0), nanoseconds(0), maxNanoseconds(0), slowCalls(0)
+    {
+    }
+
+    /// internalName of the plugin (its filename until init() returns)
+    std::string name;
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> nanoseconds;
+    std::atomic<uint64_t> maxNanoseconds;
+    /// Calls which took longer than the budget
+    std::atomic<uint64_t> slowCalls;
+};
+
+/// Attributes the lifetime of this object (a call into a plugin) to the plugin, and warns when it exceeds the budget.
+/// Does nothing for a null plugin, e.g. the built-in generator.
+class PluginCall :boost::noncopyable
+{
+public:
+    /// `what` names the callback in warnings, it must outlive this object
+    PluginCall(PluginStats* plugin, const char* what);
+    ~PluginCall();
+
+    /// Get the plugin being called on this thread, nullptr outside of plugins.
+    /// Callbacks registered by a plugin are attributed to it.
+    static PluginStats* getCurrent();
+
+    /// Set the time a call may take before it is reported
+    static void setBudget(std::chrono::nanoseconds budget);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    PluginStats* m_plugin;
+    PluginStats* m_previous;
+    const char* m_what;
+    Clock::time_point m_begin;
+};
+
+#endif // !PLUGINSTATS_H_
@@ -0,0 +1,169 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "plugintasks.h"
+#include "threadpool.h"
+
+void PluginTasks::setThreadPool(ThreadPool* pool)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pool = pool;
+}
+
+int32_t PluginTasks::scheduleAsync(PluginTaskFunction* job, PluginTaskFunction* completion, void* userData)
+{
+    if (job == nullptr) return -1;
+    std::shared_ptr<Task> task = std::make_shared<Task>();
+    task->job = job;
+    task->completion = completion;
+    task->userData = userData;
+    task->owner = PluginCall::getCurrent();
+    task->state = State::queued;
+    task->running = false;
+    task->dueTick = 0;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_pool == nullptr) return -1;
+    task->id = m_nextID++;
+    m_asyncTasks.push_back(task);
+    m_pool->post([this, task]
+    {
+        runAsync(task);
+    });
+    return task->id;
+}
+
+int32_t PluginTasks::scheduleOnTick(PluginTaskFunction* job, int32_t delay, void* userData)
+{
+    if (job == nullptr) return -1;
+    std::shared_ptr<Task> task = std::make_shared<Task>();
+    task->job = job;
+    task->completion = nullptr;
+    task->userData = userData;
+    task->owner = PluginCall::getCurrent();
+    task->state = State::queued;
+    task->running = false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    task->id = m_nextID++;
+    task->dueTick = m_tick + 1 + std::max(delay, 0);
+    m_tickTasks.push_back(task);
+    return task->id;
+}
+
+bool PluginTasks::cancel(int32_t id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (std::vector<std::shared_ptr<Task>>* tasks : { &m_asyncTasks, &m_tickTasks })
+        for (const std::shared_ptr<Task>& task : *tasks)
+            if (task->id == id && (task->state == State::queued || task->state == State::done))
+            {
+                task->state = State::cancelled;
+                return true;
+            }
+    return false;
+}
+
+void PluginTasks::cancelAll(PluginStats* owner)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (std::vector<std::shared_ptr<Task>>* tasks : { &m_asyncTasks, &m_tickTasks })
+        for (const std::shared_ptr<Task>& task : *tasks)
+            if (task->owner == owner && (task->state == State::queued || task->state == State::done))
+                task->state = State::cancelled;
+    // Running jobs can't be interrupted, the plugin code must stay loaded until they return
+    m_finished.wait(lock, [this, owner]
+    {
+        return std::none_of(m_asyncTasks.begin(), m_asyncTasks.end(), [owner](const std::shared_ptr<Task>& task)
+        {
+            return task->owner == owner && task->running;
+        });
+    });
+}
+
+void PluginTasks::runAsync(const std::shared_ptr<Task>& task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (task->state == State::cancelled) return;
+        task->running = true;
+    }
+    {
+        PluginCall call(task->owner, "an async job");
+        (*task->job)(task->userData);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        task->running = false;
+        if (task->state == State::queued) task->state = State::done;
+    }
+    m_finished.notify_all();
+}
+
+bool PluginTasks::beginDelivery(Task& task, State expected)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (task.state != expected) return false;
+    task.state = State::delivered;
+    return true;
+}
+
+void PluginTasks::tick()
+{
+    std::vector<std::shared_ptr<Task>> completed, due;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tick++;
+        for (const std::shared_ptr<Task>& task : m_asyncTasks)
+            if (task->state == State::done) completed.push_back(task);
+        for (const std::shared_ptr<Task>& task : m_tickTasks)
+            if (task->state == State::queued && task->dueTick <= m_tick) due.push_back(task);
+    }
+    // Callbacks run without the lock, they may schedule or cancel tasks (including the ones collected above)
+    for (const std::shared_ptr<Task>& task : completed)
+    {
+        if (!beginDelivery(*task, State::done) || task->completion == nullptr) continue;
+        PluginCall call(task->owner, "an async completion");
+        (*task->completion)(task->userData);
+    }
+    for (const std::shared_ptr<Task>& task : due)
+    {
+        if (!beginDelivery(*task, State::queued)) continue;
+        PluginCall call(task->owner, "a tick job");
+        (*task->job)(task->userData);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (std::vector<std::shared_ptr<Task>>* tasks : { &m_asyncTasks, &m_tickTasks })
+        tasks->erase(std::remove_if(tasks->begin(), tasks->end(), [](const std::shared_ptr<Task>& task)
+        {
+            return (task->state == State::delivered || task->state == State::cancelled) && !task->running;
+        }), tasks->end());
+}
+
+size_t PluginTasks::getPendingCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t count = 0;
+    for (const std::vector<std::shared_ptr<Task>>* tasks : { &m_asyncTasks, &m_tickTasks })
+        count += size_t(std::count_if(tasks->begin(), tasks->end(), [](const std::shared_ptr<Task>& task)
+        {
+            return task->state == State::queued || task->state == State::done;
+        }));
+    return count;
+}
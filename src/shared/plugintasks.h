@@ -0,0 +1,104 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PLUGINTASKS_H_
+#define PLUGINTASKS_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/core/noncopyable.hpp>
+#include "common.h"
+#include "pluginstats.h"
+
+class ThreadPool;
+
+/// Plugin task callback, same as NWtaskfunction in nwapi.h
+using PluginTaskFunction = void NWAPICALL(void*);
+
+/// Jobs scheduled by plugins: async jobs run on the server worker threads and complete on the tick thread,
+/// tick jobs run on the tick thread. Thread-safe, except that tick() must be called by the tick thread.
+class PluginTasks :boost::noncopyable
+{
+public:
+    PluginTasks() : m_pool(nullptr), m_nextID(0), m_tick(0)
+    {
+    }
+
+    /// Set the workers for async jobs, nullptr if there are none (async jobs are refused then)
+    void setThreadPool(ThreadPool* pool);
+
+    /// Run `job` on a worker thread, then `completion` (may be null) on the tick thread.
+    /// Return the task ID, or -1 if the job is null or there are no workers.
+    int32_t scheduleAsync(PluginTaskFunction* job, PluginTaskFunction* completion, void* userData);
+    /// Run `job` on the tick thread after `delay` ticks (0 for the next tick). Return the task ID, or -1 if the job is null.
+    int32_t scheduleOnTick(PluginTaskFunction* job, int32_t delay, void* userData);
+    /// Cancel a task. A running job is not interrupted, but its completion is dropped.
+    /// Return false if there is no such task (or it is already done).
+    bool cancel(int32_t id);
+    /// Cancel all tasks of a plugin and wait until none of its jobs is running, so that its code can be unloaded
+    void cancelAll(PluginStats* owner);
+
+    /// Deliver completed async jobs and run due tick jobs
+    void tick();
+
+    /// Get the number of tasks which have not completed yet
+    size_t getPendingCount() const;
+
+private:
+    enum class State
+    {
+        queued, done, delivered, cancelled
+    };
+
+    struct Task
+    {
+        int32_t id;
+        PluginTaskFunction* job;
+        PluginTaskFunction* completion;
+        void* userData;
+        // Plugin which scheduled the task, nullptr for NEWorld itself
+        PluginStats* owner;
+        State state;
+        // Is the async job running on a worker thread
+        bool running;
+        // Tick jobs only
+        int64_t dueTick;
+    };
+
+    ThreadPool* m_pool;
+    /// Async jobs which are not delivered yet
+    std::vector<std::shared_ptr<Task>> m_asyncTasks;
+    std::vector<std::shared_ptr<Task>> m_tickTasks;
+    int32_t m_nextID;
+    int64_t m_tick;
+    /// Protects everything above
+    mutable std::mutex m_mutex;
+    /// Signaled when an async job finishes running
+    std::condition_variable m_finished;
+
+    /// Run an async job, on a worker thread
+    void runAsync(const std::shared_ptr<Task>& task);
+    /// Mark a task as delivered, return false if it has been cancelled
+    bool beginDelivery(Task& task, State expected);
+};
+
+#endif // !PLUGINTASKS_H_
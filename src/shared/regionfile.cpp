@@ -0,0 +1,334 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "common.h"
+#include "chunkcodec.h"
+#include "logger.h"
+#include "regionfile.h"
+
+#ifdef NEWORLD_COMPILER_MSVC
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+#ifndef NEWORLD_USE_WINAPI
+    #include <sys/mman.h>
+#endif
+
+namespace
+{
+    constexpr char RegionMagic[4] = { 'N', 'W', 'R', 'G' };
+    constexpr uint32_t RegionVersion = 2;
+    // Raw payloads are aligned to this in the file, so they can be used as block arrays in place
+    constexpr uint64_t RawPayloadAlignment = 4096;
+
+    struct RegionHeader
+    {
+        char magic[4];
+        uint32_t version;
+        // BlockData(1, 2, 3) in memory, raw payloads are only usable if the layout matches
+        uint32_t blockLayout;
+        uint32_t reserved;
+    };
+
+    uint32_t getBlockLayout()
+    {
+        return BlockData(1, 2, 3).getRawData();
+    }
+}
+
+RegionFile::RegionFile(const std::string& filename, bool create)
+    : m_file(nullptr), m_filename(filename), m_fileSize(0), m_entries(new Entry[RegionChunkCount]), m_mappingAdopted(false)
+{
+    const size_t tableSize = RegionChunkCount * sizeof(Entry);
+    RegionHeader header;
+    m_file = std::fopen(filename.c_str(), "r+b");
+    if (m_file != nullptr)
+    {
+        if (std::fread(&header, sizeof(header), 1, m_file) != 1 || std::fread(m_entries.get(), tableSize, 1, m_file) != 1 ||
+                memcmp(header.magic, RegionMagic, sizeof(RegionMagic)) != 0 || header.version != RegionVersion ||
+                header.blockLayout != getBlockLayout())
+        {
+            errorstream << "Invalid region file \"" << filename << "\", ignored";
+            std::fclose(m_file);
+            m_file = nullptr;
+            return;
+        }
+        // Space between the payloads in the table is free
+        std::vector<std::pair<uint64_t, uint64_t>> used;
+        for (int i = 0; i < RegionChunkCount; i++)
+            if (ChunkEncoding(m_entries[i].encoding) != ChunkEncoding::none)
+                used.emplace_back(m_entries[i].offset, m_entries[i].length);
+        std::sort(used.begin(), used.end());
+        m_fileSize = sizeof(header) + tableSize;
+        for (const auto& extent : used)
+        {
+            if (extent.first > m_fileSize) release(m_fileSize, extent.first - m_fileSize);
+            m_fileSize = std::max(m_fileSize, extent.first + extent.second);
+        }
+        return;
+    }
+    if (!create) return;
+    m_file = std::fopen(filename.c_str(), "w+b");
+    if (m_file == nullptr)
+    {
+        errorstream << "Failed to create region file \"" << filename << "\"";
+        return;
+    }
+    memcpy(header.magic, RegionMagic, sizeof(RegionMagic));
+    header.version = RegionVersion;
+    header.blockLayout = getBlockLayout();
+    header.reserved = 0;
+    memset(m_entries.get(), 0, tableSize);
+    std::fwrite(&header, sizeof(header), 1, m_file);
+    std::fwrite(m_entries.get(), tableSize, 1, m_file);
+    std::fflush(m_file);
+    m_fileSize = sizeof(header) + tableSize;
+}
+
+RegionFile::~RegionFile()
+{
+    if (m_file) std::fclose(m_file);
+}
+
+int RegionFile::getEntryIndex(const Vec3i& chunkPos)
+{
+    return (chunkPos.x & (RegionSize - 1)) * RegionSize * RegionSize + (chunkPos.y & (RegionSize - 1)) * RegionSize +
+           (chunkPos.z & (RegionSize - 1));
+}
+
+bool RegionFile::seek(uint64_t offset)
+{
+#ifdef NEWORLD_COMPILER_MSVC
+    return _fseeki64(m_file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(m_file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+bool RegionFile::ensureMapped(uint64_t size)
+{
+    using namespace boost::interprocess;
+    if (m_mapping && m_mapping->get_size() >= size) return true;
+    try
+    {
+        // The new mapping covers the whole file, chunks keep the old one alive as long as they need it
+        file_mapping file(m_filename.c_str(), read_only);
+        m_mapping = std::make_shared<mapped_region>(file, copy_on_write);
+    }
+    catch (interprocess_exception& e)
+    {
+        warningstream << "Failed to map region file \"" << m_filename << "\": " << e.what();
+        m_mapping.reset();
+        return false;
+    }
+    return m_mapping->get_size() >= size;
+}
+
+uint64_t RegionFile::allocate(uint64_t length, uint64_t alignment)
+{
+    // First fit
+    for (auto iter = m_freeExtents.begin(); iter != m_freeExtents.end(); ++iter)
+    {
+        uint64_t begin = iter->first, end = iter->first + iter->second;
+        uint64_t offset = (begin + alignment - 1) / alignment * alignment;
+        if (offset + length > end) continue;
+        m_freeExtents.erase(iter);
+        if (offset > begin) m_freeExtents.emplace(begin, offset - begin);
+        if (offset + length < end) m_freeExtents.emplace(offset + length, end - offset - length);
+        return offset;
+    }
+    uint64_t offset = (m_fileSize + alignment - 1) / alignment * alignment;
+    if (offset > m_fileSize) release(m_fileSize, offset - m_fileSize);
+    m_fileSize = offset + length;
+    return offset;
+}
+
+void RegionFile::release(uint64_t offset, uint64_t length)
+{
+    if (length == 0) return;
+    auto next = m_freeExtents.lower_bound(offset);
+    if (next != m_freeExtents.end() && next->first == offset + length)
+    {
+        length += next->second;
+        next = m_freeExtents.erase(next);
+    }
+    if (next != m_freeExtents.begin())
+    {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset)
+        {
+            prev->second += length;
+            return;
+        }
+    }
+    m_freeExtents.emplace_hint(next, offset, length);
+}
+
+bool RegionFile::hasChunk(const Vec3i& chunkPos) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return isOpen() && ChunkEncoding(m_entries[getEntryIndex(chunkPos)].encoding) != ChunkEncoding::none;
+}
+
+bool RegionFile::readChunk(Chunk& chunk)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!isOpen()) return false;
+    const Entry& entry = m_entries[getEntryIndex(chunk.getPosition())];
+    if (ChunkEncoding(entry.encoding) == ChunkEncoding::none || !ensureMapped(entry.offset + entry.length))
+        return false;
+    uint8_t* data = static_cast<uint8_t*>(m_mapping->get_address()) + entry.offset;
+    switch (ChunkEncoding(entry.encoding))
+    {
+    case ChunkEncoding::raw:
+    {
+        if (entry.length != ChunkBlockCount * sizeof(BlockData) || entry.offset % RawPayloadAlignment != 0) break;
+        // Zero-copy: the mapping is private, so pages are only copied if the chunk gets modified
+        std::shared_ptr<void> lease = std::make_shared<std::shared_ptr<boost::interprocess::mapped_region>>(m_mapping);
+        // The chunk holds the lease as long as it uses the payload
+        m_adopted[entry.offset] = lease;
+        m_mappingAdopted = true;
+        chunk.adoptBlocks(reinterpret_cast<BlockData*>(data), std::move(lease));
+        chunk.setAttachments(nullptr);
+        return true;
+    }
+    case ChunkEncoding::compressed:
+        if (ChunkCodec::decode(data, entry.length, chunk)) return true;
+        break;
+    default:
+        break;
+    }
+    warningstream << "Corrupted chunk (" << chunk.getPosition().x << ", " << chunk.getPosition().y << ", "
+                  << chunk.getPosition().z << ") in region file \"" << m_filename << "\"";
+    return false;
+}
+
+size_t RegionFile::writeChunk(const Vec3i& chunkPos, const BlockData* blocks, const ChunkAttachments* attachments)
+{
+    std::vector<uint8_t> encoded;
+    ChunkCodec::encode(blocks, attachments, encoded);
+    // Raw payloads are bare block arrays, attachments only fit in compressed ones
+    if (encoded.size() < ChunkBlockCount * sizeof(BlockData) || (attachments != nullptr && !attachments->empty()))
+        return writeChunk(chunkPos, ChunkEncoding::compressed, encoded.data(), encoded.size());
+    return writeChunk(chunkPos, ChunkEncoding::raw, blocks, ChunkBlockCount * sizeof(BlockData));
+}
+
+size_t RegionFile::writeChunk(const Vec3i& chunkPos, ChunkEncoding encoding, const void* data, size_t length)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!isOpen()) return 0;
+    uint64_t offset = allocate(length, encoding == ChunkEncoding::raw ? RawPayloadAlignment : 1);
+    // Write the payload before publishing it in the table
+    int index = getEntryIndex(chunkPos);
+    Entry entry = { offset, uint32_t(length), uint32_t(encoding) };
+    if (!seek(offset) || std::fwrite(data, length, 1, m_file) != 1 ||
+            !seek(sizeof(RegionHeader) + index * sizeof(Entry)) || std::fwrite(&entry, sizeof(entry), 1, m_file) != 1)
+    {
+        errorstream << "Failed to write chunk (" << chunkPos.x << ", " << chunkPos.y << ", " << chunkPos.z
+                    << ") to region file \"" << m_filename << "\"";
+        release(offset, length);
+        return 0;
+    }
+    // The entry may have reached the file anyway, so it is kept like a written one, but the caller has to retry
+    const bool flushed = std::fflush(m_file) == 0;
+    // The old payload is still referenced by the table on the disk until the next sync
+    if (ChunkEncoding(m_entries[index].encoding) != ChunkEncoding::none)
+        m_replaced.emplace_back(m_entries[index].offset, m_entries[index].length);
+    m_entries[index] = entry;
+    if (!flushed)
+    {
+        errorstream << "Failed to write chunk (" << chunkPos.x << ", " << chunkPos.y << ", " << chunkPos.z
+                    << ") to region file \"" << m_filename << "\"";
+        return 0;
+    }
+    return length;
+}
+
+bool RegionFile::sync()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!isOpen()) return false;
+#ifdef NEWORLD_COMPILER_MSVC
+    if (std::fflush(m_file) != 0 || _commit(_fileno(m_file)) != 0)
+#else
+    if (std::fflush(m_file) != 0 || fsync(fileno(m_file)) != 0)
+#endif
+    {
+        errorstream << "Failed to sync region file \"" << m_filename << "\"";
+        return false;
+    }
+    bool released = false;
+    for (size_t i = 0; i < m_replaced.size();)
+    {
+        auto adopted = m_adopted.find(m_replaced[i].first);
+        if (adopted != m_adopted.end() && !adopted->second.expired())
+        {
+            i++; // Still used by a chunk, try again with the next sync
+            continue;
+        }
+        release(m_replaced[i].first, m_replaced[i].second);
+        released = true;
+        m_replaced[i] = m_replaced.back();
+        m_replaced.pop_back();
+    }
+    for (auto iter = m_adopted.begin(); iter != m_adopted.end();)
+        iter = iter->second.expired() ? m_adopted.erase(iter) : std::next(iter);
+    // Chunks may have modified pages of the mapping, whose private copies would hide payloads written there
+    if (released && m_mappingAdopted)
+    {
+        m_mapping.reset();
+        m_mappingAdopted = false;
+    }
+    return true;
+}
+
+void RegionFile::prefetch(const Vec3i& chunkPos)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!isOpen()) return;
+    const Entry& entry = m_entries[getEntryIndex(chunkPos)];
+    if (ChunkEncoding(entry.encoding) == ChunkEncoding::none || !ensureMapped(entry.offset + entry.length)) return;
+    const uint64_t pageSize = boost::interprocess::mapped_region::get_page_size();
+    uint64_t begin = entry.offset / pageSize * pageSize;
+    char* address = static_cast<char*>(m_mapping->get_address()) + begin;
+    size_t length = size_t(entry.offset + entry.length - begin);
+#ifndef NEWORLD_USE_WINAPI
+    madvise(address, length, MADV_WILLNEED);
+#else
+    // PrefetchVirtualMemory() is only available on Windows 8 and later
+    struct MemoryRange // WIN32_MEMORY_RANGE_ENTRY
+    {
+        void* address;
+        size_t length;
+    };
+    using PrefetchFunction = BOOL (WINAPI*)(HANDLE, ULONG_PTR, MemoryRange*, ULONG);
+    static const PrefetchFunction prefetchVirtualMemory =
+        reinterpret_cast<PrefetchFunction>(GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "PrefetchVirtualMemory"));
+    if (prefetchVirtualMemory == nullptr) return;
+    MemoryRange range = { address, length };
+    prefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+}
@@ -0,0 +1,134 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REGIONFILE_H_
+#define REGIONFILE_H_
+
+#include <cstdio>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/core/noncopyable.hpp>
+#include "chunk.h"
+
+namespace boost
+{
+    namespace interprocess
+    {
+        class mapped_region;
+    }
+}
+
+constexpr int RegionSizeLog2 = 4, RegionSize = 1 << RegionSizeLog2; // 2 ^ RegionSizeLog2 == 16
+constexpr int RegionChunkCount = RegionSize * RegionSize * RegionSize;
+
+/// How a chunk payload is stored in a region file
+enum class ChunkEncoding : uint32_t
+{
+    none = 0, // Chunk is not stored
+    raw = 1, // Block array in memory layout, page aligned so that it can be adopted from the mapping
+    compressed = 2 // Encoded by ChunkCodec
+};
+
+/// A region file stores the chunks of a RegionSize^3 cube of chunks.
+/// A payload is never overwritten while the chunk table on the disk refers to it: a new payload goes into free space,
+/// and the old one becomes free space after the next sync(). Raw payloads adopted by chunks stay in use until the
+/// chunks release them, so they are never changed under their feet.
+class RegionFile :boost::noncopyable
+{
+public:
+    /// Open a region file, create it if `create` is true and it does not exist
+    RegionFile(const std::string& filename, bool create);
+    ~RegionFile();
+
+    /// Is the file opened and valid
+    bool isOpen() const
+    {
+        return m_file != nullptr;
+    }
+
+    /// Is the chunk stored in this region
+    bool hasChunk(const Vec3i& chunkPos) const;
+    /// Read chunk straight from the file mapping, return false if the chunk is not stored
+    bool readChunk(Chunk& chunk);
+    /// Encode and write chunk blocks and plugin attachments, return the bytes written, 0 on failure
+    size_t writeChunk(const Vec3i& chunkPos, const BlockData* blocks, const ChunkAttachments* attachments = nullptr);
+    /// Write an encoded chunk payload, return the bytes written, 0 on failure
+    size_t writeChunk(const Vec3i& chunkPos, ChunkEncoding encoding, const void* data, size_t length);
+    /// Flush written chunks to the disk, then reuse the space of the payloads they replaced.
+    /// Return false if the chunks written since the last sync may not be on the disk.
+    bool sync();
+    /// Ask the OS to read in the payload of a chunk which will be loaded soon
+    void prefetch(const Vec3i& chunkPos);
+
+    /// Convert chunk position to region position (one axis)
+    static int getRegionPos(int chunkPos)
+    {
+        return chunkPos >= 0 ? chunkPos / RegionSize : (chunkPos - RegionSize + 1) / RegionSize;
+    }
+
+    /// Convert chunk position to region position (all axes)
+    static Vec3i getRegionPos(const Vec3i& chunkPos)
+    {
+        return Vec3i(getRegionPos(chunkPos.x), getRegionPos(chunkPos.y), getRegionPos(chunkPos.z));
+    }
+
+private:
+    /// Chunk table entry
+    struct Entry
+    {
+        uint64_t offset;
+        uint32_t length;
+        uint32_t encoding;
+    };
+
+    std::FILE* m_file;
+    std::string m_filename;
+    uint64_t m_fileSize;
+    /// Chunk table
+    std::unique_ptr<Entry[]> m_entries;
+    /// Unused space before m_fileSize: offset -> length, adjacent extents are merged
+    std::map<uint64_t, uint64_t> m_freeExtents;
+    /// Replaced payloads (offset, length), free once the new table entries are synced
+    std::vector<std::pair<uint64_t, uint64_t>> m_replaced;
+    /// Raw payloads adopted by chunks, by offset. Their space is not reused while the chunks hold them.
+    std::map<uint64_t, std::weak_ptr<void>> m_adopted;
+    /// Private (copy-on-write) mapping of the whole file
+    std::shared_ptr<boost::interprocess::mapped_region> m_mapping;
+    /// Have chunks adopted payloads from m_mapping
+    bool m_mappingAdopted;
+    /// Protects the file, the table and the mapping
+    mutable std::mutex m_mutex;
+
+    /// Index of a chunk in the chunk table
+    static int getEntryIndex(const Vec3i& chunkPos);
+    /// Make sure the mapping covers [0, size), return false on failure
+    bool ensureMapped(uint64_t size);
+    /// Find space for a payload, from the free extents or at the end of the file
+    uint64_t allocate(uint64_t length, uint64_t alignment);
+    /// Return space to the free extents
+    void release(uint64_t offset, uint64_t length);
+    /// Seek to absolute offset
+    bool seek(uint64_t offset);
+};
+
+#endif // !REGIONFILE_H_
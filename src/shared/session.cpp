@@ -18,9 +18,8 @@
 */
 
 #include "session.h"
-#include "takedatahelper.h"
-#include "identifier.h"
-#include "networkstructures.h"
+#include "logger.h"
+#include "packetdispatch.h"
 
 using namespace boost::asio;
 using namespace boost::system;
@@ -28,95 +27,105 @@ using namespace boost::posix_time;
 
 void errorHandle(const tcp::socket& m_socket, error_code ec);
 
-std::unique_ptr<NetworkStructure> makeNetworkStructure(Packet& packet)
+namespace
 {
-    TakeDataHelper tdh(packet.data, packet.length);
-    switch (packet.identifier)
-    {
-    case Login:
-    {
-        uint32_t lengthUsername = tdh.take<uint32_t>();
-        std::string username = tdh.getString(lengthUsername);
-        std::string password = tdh.getString(packet.length - lengthUsername - sizeof(uint32_t) - sizeof(uint16_t));
-        uint16_t version = tdh.take<uint16_t>();
-        return std::unique_ptr<LoginPacket>(new LoginPacket(username, password, version));
-    }
-    case Chat:
-    {
-        uint32_t length1 = tdh.take<uint32_t>();
-        uint32_t length2 = packet.length - length1;
-        std::string username = tdh.getString(length1);
-        std::string content = tdh.getString(length2);
-        return std::unique_ptr<ChatPacket>(new ChatPacket(username, content));
-    }
-    case Close:
+    // Handles decoded packets with the process() of this side (server or client)
+    struct ProcessPacket
     {
+        bool accepted = false; // Of the last packet
 
-    }
-    default:
-    {
-        return nullptr;
-    }
-    }
+        template <typename Type>
+        void operator()(const Type& packet)
+        {
+            accepted = packet.process();
+        }
+    };
 }
 
 void Session::doRead()
 {
     auto self(shared_from_this());
-    //先异步读取数据包的长度
-    async_read(m_socket, buffer(&m_packetRead, sizeof(Identifier) + sizeof(m_packetRead.length)), // Read identifier and length to packet
-               [this, self](error_code ec, std::size_t)
+    size_t size;
+    char* data = m_reader.prepare(size);
+    // As much as is available, all complete packets are processed at once
+    m_socket.async_read_some(buffer(data, size), [this, self](error_code ec, std::size_t bytes)
     {
-        if (!ec)
+        if (ec)
         {
-            //根据读到的长度新建缓存
-            m_packetRead.data = std::unique_ptr<char[]>(new char[m_packetRead.length]);
-            //异步读取数据
-            async_read(m_socket, buffer(m_packetRead.data.get(), m_packetRead.length),
-                       [this, self](error_code ec, std::size_t)
-            {
-                if (!ec)
-                {
-                    //处理接收到的数据
-                    makeNetworkStructure(m_packetRead)->process();
-                    //继续读取其他数据包
-                    doRead();
-                }
-                else
-                {
-                    errorHandle(m_socket, ec);
-                }
-            });
+            errorHandle(m_socket, ec);
+            return;
         }
-        else
+        m_reader.commit(bytes);
+        PacketHeader header;
+        const char* payload;
+        ProcessPacket process;
+        DispatchResult result = DispatchResult::handled;
+        while (result == DispatchResult::handled && m_reader.next(header, payload))
         {
-            errorHandle(m_socket, ec);
+            result = dispatchPacket(header, payload, process);
+            // Only players who logged in may send larger packets
+            if (result == DispatchResult::handled && header.identifier == Login && process.accepted)
+                m_reader.setMaxPacketLength(MaxPacketLength);
         }
+        if (result != DispatchResult::handled)
+            warningstream << "Rejected " << (result == DispatchResult::unknown ? "unknown" : "malformed")
+                          << " packet " << header.identifier;
+        if (m_reader.isMalformed() || result != DispatchResult::handled)
+        {
+            // The rest of the stream can't be trusted
+            errorHandle(m_socket, error::make_error_code(error::message_size));
+            m_socket.close(ec);
+            return;
+        }
+        doRead();
+    });
+}
+
+void Session::scheduleWrite()
+{
+    // The running write continues with the queued packets
+    if (m_flushCount != 0 || m_writeScheduled) return;
+    m_writeScheduled = true;
+    auto self(shared_from_this());
+    // Posted rather than started here, so the packets queued until the loop gets to it go in one write
+    ioService.post([this, self]()
+    {
+        m_writeScheduled = false;
+        doWrite();
     });
 }
 
 void Session::doWrite()
 {
-    if (m_packets.empty()) // No packet need sent
+    // A write is running, or no packet need sent
+    if (m_flushCount != 0 || m_packets.empty()) return;
+    // Send as many queued packets as the cap allows in one gathered write
+    size_t bytes = 0;
+    while (m_flushCount < m_packets.size())
+    {
+        const Packet& packet = m_packets[m_flushCount];
+        size_t packetBytes = PacketHeaderSize + packet.length;
+        if (m_flushCount != 0 && bytes + packetBytes > MaxFlushBytes) break;
+        bytes += packetBytes;
+        m_flushCount++;
+    }
+    // Headers first, the buffer sequence points into them
+    m_flushHeaders.resize(m_flushCount);
+    for (size_t i = 0; i < m_flushCount; i++)
+        encodePacketHeader(PacketHeader{ uint32_t(m_packets[i].identifier), m_packets[i].length }, m_flushHeaders[i].data());
+    m_flushBuffers.clear();
+    for (size_t i = 0; i < m_flushCount; i++)
     {
-        doUpdate();
-        return;
+        m_flushBuffers.push_back(buffer(m_flushHeaders[i]));
+        if (m_packets[i].length != 0) m_flushBuffers.push_back(buffer(m_packets[i].data.data(), m_packets[i].length));
     }
-    Packet& packet = m_packets.front();
     auto self(shared_from_this());
-    async_write(m_socket, buffer(&packet.identifier, sizeof(Identifier) + sizeof(packet.length)), // Send identifier and length
-                [this, self, &packet](error_code ec, std::size_t)
+    async_write(m_socket, m_flushBuffers, [this, self](error_code ec, std::size_t)
     {
-        if (!ec)
-        {
-            async_write(m_socket, buffer(packet.data.get(), packet.length), // Send data
-                        [this, self](error_code ec, std::size_t)
-            {
-                m_packets.pop();
-                if (!ec) doUpdate();
-                else errorHandle(m_socket, ec);
-            });
-        }
+        // Releases the buffers to the pool
+        m_packets.erase(m_packets.begin(), m_packets.begin() + m_flushCount);
+        m_flushCount = 0;
+        if (!ec) doWrite();
         else errorHandle(m_socket, ec);
     });
 }
@@ -20,15 +20,23 @@
 #ifndef SESSION_H_
 #define SESSION_H_
 
-#include <queue>
+#include <array>
+#include <deque>
+#include <memory>
+#include <vector>
 #include "networkshared.h"
 #include "packet.h"
+#include "packetreader.h"
+
+/// Most bytes sent by one write, so that a burst doesn't hold the socket for too long. A larger packet is sent alone.
+constexpr size_t MaxFlushBytes = 256 * 1024;
 
 class Session :public std::enable_shared_from_this<Session>
 {
 public:
-    Session(tcp::socket socket)
-        : m_socket(std::move(socket))
+    /// `maxPacketLength` limits the packets received until a login is accepted, MaxPacketLength applies afterwards
+    Session(tcp::socket socket, uint32_t maxPacketLength = MaxPacketLength)
+        : m_socket(std::move(socket)), m_flushCount(0), m_writeScheduled(false), m_reader(maxPacketLength)
     {
     }
 
@@ -38,24 +46,57 @@ public:
         doUpdate();
     }
 
-    void addRequest(Packet& packet)
+    // Queue a packet, it is sent by the network loop. Call on the thread running ioService.
+    // Copies of a packet share its data, which must not be modified once queued.
+    void addRequest(const Packet& packet)
     {
-        m_packets.push(packet);
+        m_packets.push_back(packet);
+        scheduleWrite();
     }
 
     void addRequest(Packet&& packet)
     {
-        m_packets.push(packet);
+        m_packets.push_back(std::move(packet));
+        scheduleWrite();
     }
 
 private:
     void doUpdate();
     void doRead();
     void doWrite();
+    // Post a write to the network loop unless one is running or posted already
+    void scheduleWrite();
 
     tcp::socket m_socket;
-    std::queue<Packet> m_packets; // Packets need sent
-    Packet m_packetRead;
+    std::deque<Packet> m_packets; // Packets need sent
+    // Packets at the front of m_packets being written, 0 when no write is in progress
+    size_t m_flushCount;
+    bool m_writeScheduled;
+    // Headers and buffer sequence of the write in progress, reused between writes
+    std::vector<std::array<char, PacketHeaderSize>> m_flushHeaders;
+    std::vector<boost::asio::const_buffer> m_flushBuffers;
+    PacketReader m_reader; // Received bytes
 };
 
+// Queue a packet on every live session and drop the expired ones. The sessions share the encoded data.
+template <typename SessionType>
+void sendToAllSessions(std::vector<std::weak_ptr<SessionType>>& sessions, const Packet& packet)
+{
+    for (size_t i = 0; i < sessions.size();)
+    {
+        auto session = sessions[i].lock();
+        if (session)
+        {
+            session->addRequest(packet); // Shares the buffer
+            i++;
+        }
+        else
+        {
+            // Order doesn't matter, swap with the last one instead of shifting the rest
+            sessions[i] = std::move(sessions.back());
+            sessions.pop_back();
+        }
+    }
+}
+
 #endif // !SESSION_H_
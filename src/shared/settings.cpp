@@ -20,6 +20,7 @@
 #include "settingsmanager.h"
 #include "logger.h"
 #include "common.h"
+#include "pluginstats.h"
 
 void loadSharedSettings(Settings& settings)
 {
@@ -38,4 +39,5 @@ void loadSharedSettings(Settings& settings)
 #endif
     */
     settings.setMinimal(settings.get<bool>("shared.settings.minimal", false));
+    PluginCall::setBudget(std::chrono::milliseconds(settings.get<int>("shared.plugins.slowCallMs", DefaultPluginCallBudgetMs)));
 }
@@ -19,39 +19,49 @@
 
 #ifndef TAKEDATAHELPER_H_
 #define TAKEDATAHELPER_H_
-#include <memory>
+#include <cstddef>
+#include <boost/utility/string_ref.hpp>
+#include "littleendian.h"
 
-/// A helper class for taking data out of a byte array
+/// A helper class for taking data out of a byte array, in place. The array must outlive the helper.
+/// Every take checks the bounds and returns false, without moving on, if there are not enough bytes left.
+/// Integers are little-endian and may be unaligned.
 class TakeDataHelper
 {
 public:
-    TakeDataHelper(std::shared_ptr<char> buffer, size_t length)
-        : m_buffer(buffer.get()), m_length(length), m_offset(0), m_shared_ptr(buffer)
+    TakeDataHelper(const char* buffer, size_t length)
+        : m_buffer(buffer), m_length(length), m_offset(0)
     {
     }
 
     template <typename T>
-    T take()
+    bool take(T& value)
     {
-        if (m_offset + sizeof(T) > m_length) throw;
-        T ret = *reinterpret_cast<T*>(m_buffer + m_offset);
+        if (getRemaining() < sizeof(T)) return false;
+        value = loadLittleEndian<T>(m_buffer + m_offset);
         m_offset += sizeof(T);
-        return ret;
+        return true;
     }
 
-    std::string getString(size_t length)
+    /// Take `length` bytes as a string which points into the array
+    bool takeString(size_t length, boost::string_ref& str)
     {
-        if (m_offset + length >= m_length) throw;
-        char* ret = m_buffer + m_offset;
+        if (getRemaining() < length) return false;
+        str = boost::string_ref(m_buffer + m_offset, length);
         m_offset += length;
-        return std::string(ret, length);
+        return true;
+    }
+
+    /// Get the number of bytes left
+    size_t getRemaining() const
+    {
+        return m_length - m_offset;
     }
 
 private:
-    char* m_buffer;
+    const char* m_buffer;
     size_t m_length;
     size_t m_offset;
-    std::shared_ptr<char> m_shared_ptr;
 };
 
 #endif // !TAKEDATAHELPER_H_
@@ -0,0 +1,114 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "logger.h"
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(size_t threadCount)
+    : m_running(0), m_stop(false)
+{
+    if (threadCount == 0) threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    for (size_t i = 0; i < threadCount; i++) m_threads.emplace_back(&ThreadPool::workerFunc, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_queued.notify_all();
+    for (auto& thread : m_threads) thread.join();
+}
+
+void ThreadPool::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_queued.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_tasks.empty() && m_running == 0; });
+}
+
+size_t ThreadPool::getPendingCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_tasks.size() + m_running;
+}
+
+void TaskGroup::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending++;
+    }
+    m_pool.post([this, task]()
+    {
+        // Counted as done even if the task throws
+        struct Done
+        {
+            TaskGroup& group;
+
+            ~Done()
+            {
+                std::lock_guard<std::mutex> lock(group.m_mutex);
+                if (--group.m_pending == 0) group.m_done.notify_all();
+            }
+        } done{ *this };
+        task();
+    });
+}
+
+void TaskGroup::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_pending == 0; });
+}
+
+void ThreadPool::workerFunc()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_queued.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+        if (m_tasks.empty()) break; // Stopped and drained
+        std::function<void()> task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        m_running++;
+        lock.unlock();
+        try
+        {
+            task();
+        }
+        catch (std::exception& e)
+        {
+            errorstream << "Exception in thread pool task: " << e.what();
+        }
+        lock.lock();
+        m_running--;
+        if (m_tasks.empty() && m_running == 0) m_idle.notify_all();
+    }
+}
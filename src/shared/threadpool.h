@@ -0,0 +1,98 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <boost/core/noncopyable.hpp>
+
+/// Fixed-size pool of worker threads running tasks in FIFO order
+class ThreadPool :boost::noncopyable
+{
+public:
+    /// Start `threadCount` workers, one per hardware thread if 0
+    explicit ThreadPool(size_t threadCount = 0);
+    /// Run the remaining tasks and stop the workers
+    ~ThreadPool();
+
+    /// Queue a task
+    void post(std::function<void()> task);
+    /// Wait until all queued tasks are done
+    void wait();
+
+    /// Get worker count
+    size_t getThreadCount() const
+    {
+        return m_threads.size();
+    }
+
+    /// Get the number of queued or running tasks
+    size_t getPendingCount() const;
+
+private:
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_tasks;
+    /// Tasks being run by workers
+    size_t m_running;
+    bool m_stop;
+    mutable std::mutex m_mutex;
+    /// Signaled when tasks are queued or the workers should stop
+    std::condition_variable m_queued;
+    /// Signaled when all tasks are done
+    std::condition_variable m_idle;
+
+    /// Worker main loop
+    void workerFunc();
+};
+
+/// Tasks posted to a pool together. wait() only waits for them, not for the other tasks of the pool.
+class TaskGroup :boost::noncopyable
+{
+public:
+    explicit TaskGroup(ThreadPool& pool) : m_pool(pool), m_pending(0)
+    {
+    }
+
+    /// Wait for the tasks of the group
+    ~TaskGroup()
+    {
+        wait();
+    }
+
+    /// Queue a task in the pool
+    void post(std::function<void()> task);
+    /// Wait until the tasks of the group are done
+    void wait();
+
+private:
+    ThreadPool& m_pool;
+    /// Tasks of the group which are queued or running
+    size_t m_pending;
+    std::mutex m_mutex;
+    /// Signaled when m_pending drops to zero
+    std::condition_variable m_done;
+};
+
+#endif // !THREADPOOL_H_
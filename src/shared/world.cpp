@@ -17,6 +17,7 @@
 * along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <boost/filesystem/operations.hpp>
 #include "logger.h"
 #include "world.h"
 #include "chunk.h"
@@ -40,32 +41,30 @@ void World::expandChunkArray(size_t c)
 
 size_t World::getChunkIndex(const Vec3i& pos) const
 {
-    // Binary search
-    assert(m_chunkCount);
-    size_t first = 0, last = m_chunkCount - 1, middle;
-    do
+    // Binary search (lower bound)
+    size_t first = 0, last = m_chunkCount;
+    while (first < last)
     {
-        middle = (first + last) / 2;
-        const Vec3i& curr = m_chunks[middle]->getPosition();
-        if (curr > pos)
-            last = middle - 1;
-        else if (curr < pos)
+        size_t middle = (first + last) / 2;
+        if (m_chunks[middle]->getPosition() < pos)
             first = middle + 1;
+        else
+            last = middle;
     }
-    while (first <= last);
-    return middle;
+    return first;
 }
 
 Chunk* World::addChunk(const Vec3i& chunkPos)
 {
-    int index = getChunkIndex(chunkPos);
-    if (m_chunkCount && m_chunks[index]->getPosition() == chunkPos)
+    size_t index = getChunkIndex(chunkPos);
+    if (index < m_chunkCount && m_chunks[index]->getPosition() == chunkPos)
     {
         assert(false);
         return nullptr;
     }
     newChunkPtr(index);
     m_chunks[index] = new Chunk(chunkPos);
+    m_events.chunkLoaded(chunkPos);
     // TODO: Update chunk pointer cache
     // TODO: Update chunk pointer array
     // Return pointer
@@ -74,18 +73,196 @@ Chunk* World::addChunk(const Vec3i& chunkPos)
 
 int World::deleteChunk(const Vec3i& chunkPos)
 {
-    int index = getChunkIndex(chunkPos);
-    if (m_chunkCount == 0 || m_chunks[index]->getPosition() != chunkPos)
+    size_t index = getChunkIndex(chunkPos);
+    if (index >= m_chunkCount || m_chunks[index]->getPosition() != chunkPos)
     {
         assert(false);
         return 1;
     }
     delete m_chunks[index];
     eraseChunkPtr(index);
+    m_events.chunkUnloaded(chunkPos);
     // Update chunk pointer array
     return 0;
 }
 
+namespace
+{
+    // Call `func(chunk, run, pos, length)` for each run of loaded blocks in the box [min, max] (world positions),
+    // see Chunk::forEachRun. `pos` is a world position.
+    template <typename Func>
+    void forEachRun(const World& world, const Vec3i& min, const Vec3i& max, Func func)
+    {
+        if (min.x > max.x || min.y > max.y || min.z > max.z) return;
+        Vec3i first = World::getChunkPos(min), last = World::getChunkPos(max);
+        auto visit = [&](Chunk* chunk)
+        {
+            Vec3i base = chunk->getPosition() * ChunkSize;
+            // Written to not overflow for boxes reaching the ends of the int range
+            Vec3i lower(std::max(min.x, base.x) - base.x, std::max(min.y, base.y) - base.y, std::max(min.z, base.z) - base.z);
+            Vec3i upper(std::min(max.x, base.x + ChunkSize - 1) - base.x, std::min(max.y, base.y + ChunkSize - 1) - base.y,
+                        std::min(max.z, base.z + ChunkSize - 1) - base.z);
+            chunk->forEachRun(lower, upper, [&](BlockData* run, const Vec3i& pos, int length)
+            {
+                func(*chunk, run, base + pos, length);
+            });
+        };
+        // Boxes with more chunk positions than loaded chunks scan the loaded chunks instead
+        uint64_t sizeX = uint64_t(int64_t(last.x) - first.x + 1), sizeY = uint64_t(int64_t(last.y) - first.y + 1),
+                 sizeZ = uint64_t(int64_t(last.z) - first.z + 1);
+        if (sizeX * sizeY > world.getChunkCount() || sizeX * sizeY * sizeZ > world.getChunkCount())
+        {
+            for (size_t i = 0; i < world.getChunkCount(); i++)
+            {
+                Chunk* chunk = world.getChunkPtr(i);
+                const Vec3i& pos = chunk->getPosition();
+                if (pos.x >= first.x && pos.x <= last.x && pos.y >= first.y && pos.y <= last.y &&
+                    pos.z >= first.z && pos.z <= last.z)
+                    visit(chunk);
+            }
+            return;
+        }
+        Vec3i curr;
+        for (curr.x = first.x; curr.x <= last.x; curr.x++)
+            for (curr.y = first.y; curr.y <= last.y; curr.y++)
+                for (curr.z = first.z; curr.z <= last.z; curr.z++)
+                {
+                    Chunk* chunk = world.getChunkPtr(curr);
+                    if (chunk != nullptr) visit(chunk);
+                }
+    }
+
+    // Index of a world position in a region buffer of the box [min, max]
+    size_t getRegionIndex(const Vec3i& min, const Vec3i& max, const Vec3i& pos)
+    {
+        return (size_t(pos.x - min.x) * size_t(max.y - min.y + 1) + size_t(pos.y - min.y)) * size_t(max.z - min.z + 1)
+               + size_t(pos.z - min.z);
+    }
+}
+
+size_t World::getBlocks(const Vec3i* positions, size_t count, BlockData* blocks) const
+{
+    size_t res = 0;
+    const Chunk* chunk = nullptr;
+    for (size_t i = 0; i < count; i++)
+    {
+        Vec3i chunkPos = getChunkPos(positions[i]);
+        // Nearby positions usually share a chunk
+        if (chunk == nullptr || chunk->getPosition() != chunkPos) chunk = getChunkPtr(chunkPos);
+        if (chunk == nullptr) continue;
+        blocks[i] = chunk->getBlock(getBlockPos(positions[i]));
+        res++;
+    }
+    return res;
+}
+
+void World::commitEdits(const std::vector<std::pair<Vec3i, BlockData>>& edits)
+{
+    if (edits.empty()) return;
+    if (m_journal) m_journal->append(edits);
+    m_events.blocksChanged(edits.begin(), edits.end());
+}
+
+size_t World::fillBlocks(const Vec3i& min, const Vec3i& max, BlockData block)
+{
+    const uint32_t data = block.getRawData();
+    const bool record = wantsEdits();
+    std::vector<std::pair<Vec3i, BlockData>> edits;
+    size_t count = 0;
+    forEachRun(*this, min, max, [&](Chunk& chunk, BlockData* run, const Vec3i& pos, int length)
+    {
+        size_t before = count;
+        for (int i = 0; i < length; i++)
+        {
+            if (run[i].getRawData() == data) continue;
+            run[i] = block;
+            count++;
+            if (record) edits.emplace_back(Vec3i(pos.x, pos.y, pos.z + i), block);
+        }
+        if (count != before) chunk.setDirty(true);
+    });
+    commitEdits(edits);
+    return count;
+}
+
+size_t World::replaceBlocks(const Vec3i& min, const Vec3i& max, int from, BlockData block)
+{
+    const uint32_t data = block.getRawData();
+    const bool record = wantsEdits();
+    std::vector<std::pair<Vec3i, BlockData>> edits;
+    size_t count = 0;
+    forEachRun(*this, min, max, [&](Chunk& chunk, BlockData* run, const Vec3i& pos, int length)
+    {
+        size_t before = count;
+        for (int i = 0; i < length; i++)
+        {
+            if (run[i].getID() != from || run[i].getRawData() == data) continue;
+            run[i] = block;
+            count++;
+            if (record) edits.emplace_back(Vec3i(pos.x, pos.y, pos.z + i), block);
+        }
+        if (count != before) chunk.setDirty(true);
+    });
+    commitEdits(edits);
+    return count;
+}
+
+size_t World::copyBlocksIn(const Vec3i& min, const Vec3i& max, const BlockData* src)
+{
+    const bool record = wantsEdits();
+    std::vector<std::pair<Vec3i, BlockData>> edits;
+    size_t count = 0;
+    forEachRun(*this, min, max, [&](Chunk& chunk, BlockData* run, const Vec3i& pos, int length)
+    {
+        const BlockData* from = src + getRegionIndex(min, max, pos);
+        size_t before = count;
+        for (int i = 0; i < length; i++)
+        {
+            if (run[i].getRawData() == from[i].getRawData()) continue;
+            run[i] = from[i];
+            count++;
+            if (record) edits.emplace_back(Vec3i(pos.x, pos.y, pos.z + i), from[i]);
+        }
+        if (count != before) chunk.setDirty(true);
+    });
+    commitEdits(edits);
+    return count;
+}
+
+size_t World::copyBlocksOut(const Vec3i& min, const Vec3i& max, BlockData* dst) const
+{
+    size_t count = 0;
+    forEachRun(*this, min, max, [&](Chunk&, BlockData* run, const Vec3i& pos, int length)
+    {
+        std::copy(run, run + length, dst + getRegionIndex(min, max, pos));
+        count += length;
+    });
+    return count;
+}
+
+bool World::setAttachment(const Vec3i& pos, uint32_t plugin, const uint8_t* data, size_t length)
+{
+    Chunk* chunk = getChunkPtr(getChunkPos(pos));
+    if (chunk == nullptr) return false;
+    int index = Chunk::getBlockIndex(getBlockPos(pos));
+    chunk->setDirty(true);
+    if (length != 0) chunk->getOrCreateAttachments().set(plugin, index, data, length);
+    else if (chunk->getAttachments() != nullptr)
+    {
+        chunk->getAttachments()->remove(plugin, index);
+        // Chunks without attachments don't keep an empty table around
+        if (chunk->getAttachments()->empty()) chunk->setAttachments(nullptr);
+    }
+    return true;
+}
+
+const std::vector<uint8_t>* World::getAttachment(const Vec3i& pos, uint32_t plugin) const
+{
+    const Chunk* chunk = getChunkPtr(getChunkPos(pos));
+    if (chunk == nullptr || chunk->getAttachments() == nullptr) return nullptr;
+    return chunk->getAttachments()->get(plugin, Chunk::getBlockIndex(getBlockPos(pos)));
+}
+
 std::vector<AABB> World::getHitboxes(const AABB& range) const
 {
     std::vector<AABB> res;
@@ -103,6 +280,74 @@ std::vector<AABB> World::getHitboxes(const AABB& range) const
     return res;
 }
 
+int World::loadSnapshot()
+{
+    if (!m_storage) return 0;
+    std::string filename = getSnapshotFilename();
+    int count = 0;
+    // Edits replayed from the journal are newer than the snapshot
+    if (m_journal->getReplayedCount() == 0)
+    {
+        // Spawn chunks are copied to the warm tier still encoded, the loader decodes them when they are needed
+        WorldMetadata metadata;
+        count = WorldSnapshot::load(filename, metadata, [this](const Vec3i& pos, const uint8_t* data, size_t length)
+        {
+            m_cache.putEncoded(pos, data, length);
+        });
+        if (count >= 0) m_daylightBrightness = metadata.daylightBrightness;
+        else count = 0;
+    }
+    // The world changes from now on, the snapshot must not be loaded again after a crash
+    boost::system::error_code ec;
+    boost::filesystem::remove(filename, ec);
+    return count;
+}
+
+void World::saveSnapshot()
+{
+    if (!m_storage) return;
+    std::vector<const Chunk*> chunks;
+    std::vector<std::unique_ptr<Chunk>> saved;
+    // In position order, so that loading only appends to the chunk array
+    Vec3i pos;
+    for (pos.x = -SpawnSnapshotRadius; pos.x <= SpawnSnapshotRadius; pos.x++)
+        for (pos.y = -SpawnSnapshotRadius; pos.y <= SpawnSnapshotRadius; pos.y++)
+            for (pos.z = -SpawnSnapshotRadius; pos.z <= SpawnSnapshotRadius; pos.z++)
+            {
+                const Chunk* chunk = getChunkPtrNonclustered(pos);
+                if (chunk == nullptr)
+                {
+                    std::unique_ptr<Chunk> savedChunk(new Chunk(pos));
+                    if (!m_storage->loadChunk(*savedChunk)) continue;
+                    chunk = savedChunk.get();
+                    saved.push_back(std::move(savedChunk));
+                }
+                chunks.push_back(chunk);
+            }
+    if (chunks.empty()) return;
+    WorldMetadata metadata;
+    metadata.daylightBrightness = m_daylightBrightness;
+    if (WorldSnapshot::save(getSnapshotFilename(), metadata, chunks))
+        infostream << "Saved " << chunks.size() << " spawn chunks to the world snapshot";
+}
+
 void World::update()
 {
+    m_events.flush(this);
+    // Compact the journal: once all changed chunks are saved, the edits journaled so far are no longer needed
+    if (m_journal && m_journal->needsCompaction())
+    {
+        saveDirtyChunks();
+        m_journal->checkpoint();
+    }
+}
+
+void World::saveDirtyChunks()
+{
+    for (size_t i = 0; i < m_chunkCount; i++)
+    {
+        if (!m_chunks[i]->isDirty()) continue;
+        m_storage->saveChunk(*m_chunks[i]);
+        m_chunks[i]->setDirty(false);
+    }
 }
@@ -28,17 +28,31 @@
 #include "chunk.h"
 #include "blockmanager.h"
 #include "chunkpointerarray.h"
+#include "worldstorage.h"
+#include "blockjournal.h"
+#include "chunkcache.h"
+#include "worldsnapshot.h"
+#include "generationpipeline.h"
+#include "pluginmanager.h"
 
-class PluginManager;
+// Chebyshev radius (in chunks) of the spawn region kept in the world snapshot
+constexpr int SpawnSnapshotRadius = 4;
 
 class World :boost::noncopyable
 {
 public:
-    World(const std::string& name, PluginManager& plugins, BlockManager& blocks)
-        : m_name(name), m_plugins(plugins), m_blocks(blocks), m_chunkCount(0), m_chunkArraySize(1024), m_daylightBrightness(15), m_cpa(8)
+    // `savePath` is the directory of the world save, empty for a world which is only kept in memory (e.g. on clients)
+    World(const std::string& name, PluginManager& plugins, BlockManager& blocks, const std::string& savePath = std::string())
+        : m_name(name), m_plugins(plugins), m_blocks(blocks), m_chunkCount(0), m_chunkArraySize(1024), m_daylightBrightness(15), m_cpa(8),
+          m_events(plugins.getEvents())
     {
         //m_chunks = new Chunk*[m_chunkArraySize];
         m_chunks = reinterpret_cast<Chunk**>(malloc(m_chunkArraySize * sizeof(Chunk*)));
+        if (!savePath.empty())
+        {
+            m_storage.reset(new WorldStorage(savePath));
+            m_journal.reset(new BlockJournal(*m_storage));
+        }
     }
 
     //fixme: m_cpa
@@ -52,7 +66,15 @@ public:
     {
         if (m_chunks)
         {
-            // TODO: Save and destroy chunks
+            if (m_storage)
+            {
+                saveSnapshot();
+                saveDirtyChunks();
+                m_storage->flush();
+                // Everything journaled is saved now
+                m_journal->checkpoint();
+            }
+            for (size_t i = 0; i < m_chunkCount; i++) delete m_chunks[i];
             free(m_chunks);
         }
     }
@@ -93,14 +115,15 @@ public:
     {
         // TODO: Try chunk pointer array
         size_t index = getChunkIndex(chunkPos);
-        if (m_chunks[index]->getPosition() != chunkPos) return nullptr;
+        if (index >= m_chunkCount || m_chunks[index]->getPosition() != chunkPos) return nullptr;
         Chunk* res = m_chunks[index];
         return res;
     }
 
     bool isChunkLoaded(const Vec3i& chunkPos) const
     {
-        return m_chunks[getChunkIndex(chunkPos)]->getPosition() == chunkPos;
+        size_t index = getChunkIndex(chunkPos);
+        return index < m_chunkCount && m_chunks[index]->getPosition() == chunkPos;
     }
 
     // Add chunk
@@ -157,14 +180,41 @@ public:
         return chunk->getBlock(getBlockPos(pos));
     }
 
-    // Set block data
-    void setBlock(const Vec3i& pos, BlockData block) const
+    // Get blocks at `count` positions into `blocks`, return the number of positions in loaded chunks.
+    // Blocks of unloaded chunks are left untouched.
+    size_t getBlocks(const Vec3i* positions, size_t count, BlockData* blocks) const;
+
+    // Set block data, return the journal sequence number of the edit (0 if the world is not saved)
+    // Doesn't wait for the disk: the edit is crash-safe once getJournal()->waitDurable() returns for it,
+    // a crash before the journal commits it (usually within milliseconds) loses it
+    uint64_t setBlock(const Vec3i& pos, BlockData block)
     {
         Chunk* chunk = getChunkPtr(getChunkPos(pos));
         assert(chunk != nullptr);
         chunk->setBlock(getBlockPos(pos), block);
+        m_events.blockChanged(pos, block);
+        return m_journal ? m_journal->append(pos, block) : 0;
     }
 
+    // Bulk edits of the box [min, max] (world positions, inclusive) with one chunk lookup per chunk.
+    // Blocks in chunks which are not loaded are skipped, changed blocks are journaled in one group.
+    // Region buffers hold the box like a chunk: block (x, y, z) at ((x * sizeY) + y) * sizeZ + z, relative to min.
+
+    // Fill the box with `block`, return the number of changed blocks
+    size_t fillBlocks(const Vec3i& min, const Vec3i& max, BlockData block);
+    // Replace blocks of ID `from` in the box with `block`, return the number of changed blocks
+    size_t replaceBlocks(const Vec3i& min, const Vec3i& max, int from, BlockData block);
+    // Copy the box from a region buffer, return the number of changed blocks
+    size_t copyBlocksIn(const Vec3i& min, const Vec3i& max, const BlockData* src);
+    // Copy the box to a region buffer, return the number of copied blocks
+    size_t copyBlocksOut(const Vec3i& min, const Vec3i& max, BlockData* dst) const;
+
+    // Attach plugin data to a block, empty data removes it. Return false if the chunk is not loaded.
+    // Attachments are saved with their chunk, they are not journaled.
+    bool setAttachment(const Vec3i& pos, uint32_t plugin, const uint8_t* data, size_t length);
+    // Get the data attached by a plugin to a block, nullptr if there is none or the chunk is not loaded
+    const std::vector<uint8_t>* getAttachment(const Vec3i& pos, uint32_t plugin) const;
+
     int getDaylightBrightness() const
     {
         return m_daylightBrightness;
@@ -175,9 +225,45 @@ public:
         return m_blocks;
     }
 
+    // Get plugin events waiting for the end of the tick
+    PluginEventQueue& getEvents()
+    {
+        return m_events;
+    }
+
+    // Get chunk persistence of this world, nullptr if the world is only kept in memory
+    WorldStorage* getStorage()
+    {
+        return m_storage.get();
+    }
+
+    // Get recently unloaded chunks
+    ChunkCache& getChunkCache()
+    {
+        return m_cache;
+    }
+
+    // Get block edit journal of this world, nullptr if the world is only kept in memory
+    BlockJournal* getJournal()
+    {
+        return m_journal.get();
+    }
+
+    // Get the staged generator of this world, not thread-safe
+    GenerationPipeline& getGenerationPipeline()
+    {
+        return m_pipeline;
+    }
+
     std::vector<AABB> getHitboxes(const AABB& range) const;
 
-    // Main update
+    // Read the spawn region from the snapshot left by the last clean shutdown into the chunk cache,
+    // return the chunk count. Should be called before any chunk is loaded. Only for saved worlds.
+    int loadSnapshot();
+    // Write the spawn region and world metadata to the snapshot, only for saved worlds
+    void saveSnapshot();
+
+    // Main update, delivers the plugin events of this tick
     void update();
 
 private:
@@ -198,6 +284,17 @@ private:
 
     int m_daylightBrightness;
 
+    // Saved chunks, nullptr if the world is only kept in memory
+    std::unique_ptr<WorldStorage> m_storage;
+    // Block edits since the chunks were saved, nullptr if the world is only kept in memory
+    std::unique_ptr<BlockJournal> m_journal;
+    // Recently unloaded chunks
+    ChunkCache m_cache;
+    // Chunks being generated
+    GenerationPipeline m_pipeline;
+    // Plugin events of this tick
+    PluginEventQueue m_events;
+
     // Expand chunk array
     void expandChunkArray(size_t expandCount);
 
@@ -225,9 +322,27 @@ private:
         reduceChunkArray(1);
     }
 
+    // Get the snapshot filename
+    std::string getSnapshotFilename() const
+    {
+        return m_storage->getPath() + "spawn.nws";
+    }
+
     // Search chunk index, or the index the chunk should insert into
     size_t getChunkIndex(const Vec3i& chunkPos) const;
 
+    // Bulk edits only keep the changed blocks if the journal or a plugin needs them
+    bool wantsEdits() const
+    {
+        return m_journal || m_events.wantsBlockChanges();
+    }
+
+    // Journal bulk edits and queue their plugin events
+    void commitEdits(const std::vector<std::pair<Vec3i, BlockData>>& edits);
+
+    // Queue the loaded chunks which changed since they were saved, only for saved worlds
+    void saveDirtyChunks();
+
 };
 
 #endif // !WORLD_H_
@@ -20,6 +20,7 @@
 #ifndef WORLDMANAGER_H_
 #define WORLDMANAGER_H_
 
+#include <string>
 #include <vector>
 
 #include "world.h"
@@ -30,18 +31,21 @@
 class WorldManager
 {
 public:
-    WorldManager(PluginManager& plugins, BlockManager& blocks) : m_plugins(plugins), m_blocks(blocks)
+    // Worlds are saved in `savePath` + world name, or only kept in memory if `savePath` is empty
+    WorldManager(PluginManager& plugins, BlockManager& blocks, const std::string& savePath = std::string())
+        : m_plugins(plugins), m_blocks(blocks), m_savePath(savePath)
     {
     }
 
     ~WorldManager()
     {
+        for (World* world : m_worlds) delete world;
         m_worlds.clear();
     }
 
     World* addWorld(const std::string& name)
     {
-        m_worlds.emplace_back(new World(name, m_plugins, m_blocks));
+        m_worlds.emplace_back(new World(name, m_plugins, m_blocks, m_savePath.empty() ? std::string() : m_savePath + name + "/"));
         return m_worlds[m_worlds.size() - 1];
     }
 
@@ -52,6 +56,7 @@ private:
     std::vector<World*> m_worlds;
     PluginManager& m_plugins;
     BlockManager& m_blocks;
+    std::string m_savePath;
 };
 
 #endif
@@ -0,0 +1,182 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "common.h"
+#include "chunkcodec.h"
+#include "logger.h"
+#include "worldsnapshot.h"
+
+#ifdef NEWORLD_COMPILER_MSVC
+    #include <io.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace WorldSnapshot
+{
+    namespace
+    {
+        constexpr char SnapshotMagic[4] = { 'N', 'W', 'S', 'S' };
+        constexpr uint32_t SnapshotVersion = 1;
+
+        struct Header
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t chunkCount;
+            int32_t daylightBrightness;
+        };
+
+        struct Entry
+        {
+            int32_t x, y, z;
+            uint32_t length;
+            uint64_t offset;
+        };
+
+        // Flush a written file to the disk
+        bool syncFile(std::FILE* file)
+        {
+            if (fflush(file) != 0) return false;
+#ifdef NEWORLD_COMPILER_MSVC
+            return _commit(_fileno(file)) == 0;
+#else
+            return fsync(fileno(file)) == 0;
+#endif
+        }
+
+        // Flush the directory entry of a renamed file to the disk, so that the rename survives a crash
+        void syncDirectory(const std::string& filename)
+        {
+#ifndef NEWORLD_COMPILER_MSVC
+            std::string directory = boost::filesystem::path(filename).parent_path().string();
+            int fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+            if (fd < 0) return;
+            fsync(fd);
+            close(fd);
+#else
+            (void)filename; // Not needed on Windows
+#endif
+        }
+    }
+
+    bool save(const std::string& filename, const WorldMetadata& metadata, const std::vector<const Chunk*>& chunks)
+    {
+        Header header;
+        memcpy(header.magic, SnapshotMagic, sizeof(SnapshotMagic));
+        header.version = SnapshotVersion;
+        header.chunkCount = uint32_t(chunks.size());
+        header.daylightBrightness = metadata.daylightBrightness;
+
+        std::vector<Entry> entries(chunks.size());
+        std::vector<uint8_t> payloads;
+        uint64_t offset = sizeof(Header) + chunks.size() * sizeof(Entry);
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            size_t begin = payloads.size();
+            ChunkCodec::encode(chunks[i]->getBlocks(), chunks[i]->getAttachments(), payloads);
+            entries[i].x = chunks[i]->getPosition().x;
+            entries[i].y = chunks[i]->getPosition().y;
+            entries[i].z = chunks[i]->getPosition().z;
+            entries[i].length = uint32_t(payloads.size() - begin);
+            entries[i].offset = offset + begin;
+        }
+
+        // Write to a temporary file first, a torn snapshot must never replace a good one
+        std::string temp = filename + ".tmp";
+        std::FILE* file = fopen(temp.c_str(), "wb");
+        if (file == nullptr)
+        {
+            errorstream << "Failed to create world snapshot \"" << temp << "\"";
+            return false;
+        }
+        // The data must be on the disk before the rename, or a crash could leave an empty snapshot in its place
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(entries.data(), sizeof(Entry), entries.size(), file) == entries.size() &&
+                  fwrite(payloads.data(), 1, payloads.size(), file) == payloads.size() && syncFile(file);
+        ok = fclose(file) == 0 && ok;
+        boost::system::error_code ec;
+        if (ok) boost::filesystem::rename(temp, filename, ec);
+        if (!ok || ec)
+        {
+            errorstream << "Failed to write world snapshot \"" << filename << "\"";
+            boost::filesystem::remove(temp, ec);
+            return false;
+        }
+        syncDirectory(filename);
+        return true;
+    }
+
+    int load(const std::string& filename, WorldMetadata& metadata,
+             const std::function<void(const Vec3i&, const uint8_t*, size_t)>& addChunk)
+    {
+        using namespace boost::interprocess;
+        boost::system::error_code ec;
+        if (!boost::filesystem::exists(filename, ec)) return -1;
+        try
+        {
+            file_mapping file(filename.c_str(), read_only);
+            mapped_region mapping(file, read_only);
+            const uint8_t* data = reinterpret_cast<const uint8_t*>(mapping.get_address());
+            const size_t size = mapping.get_size();
+
+            Header header;
+            if (size < sizeof(header)) return -1;
+            memcpy(&header, data, sizeof(header));
+            if (memcmp(header.magic, SnapshotMagic, sizeof(SnapshotMagic)) != 0 || header.version != SnapshotVersion ||
+                    (size - sizeof(header)) / sizeof(Entry) < header.chunkCount)
+            {
+                warningstream << "Invalid world snapshot \"" << filename << "\", ignored";
+                return -1;
+            }
+
+            // Validate the table first, so that a truncated snapshot adds nothing
+            const uint8_t* table = data + sizeof(header);
+            for (uint32_t i = 0; i < header.chunkCount; i++)
+            {
+                Entry entry;
+                memcpy(&entry, table + i * sizeof(Entry), sizeof(entry));
+                if (entry.offset > size || entry.length > size - entry.offset)
+                {
+                    errorstream << "Truncated world snapshot \"" << filename << "\", ignored";
+                    return -1;
+                }
+            }
+            metadata.daylightBrightness = header.daylightBrightness;
+            for (uint32_t i = 0; i < header.chunkCount; i++)
+            {
+                Entry entry;
+                memcpy(&entry, table + i * sizeof(Entry), sizeof(entry));
+                addChunk(Vec3i(entry.x, entry.y, entry.z), data + entry.offset, entry.length);
+            }
+            return int(header.chunkCount);
+        }
+        catch (interprocess_exception& e)
+        {
+            errorstream << "Failed to map world snapshot \"" << filename << "\": " << e.what();
+            return -1;
+        }
+    }
+}
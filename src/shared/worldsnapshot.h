@@ -0,0 +1,52 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WORLDSNAPSHOT_H_
+#define WORLDSNAPSHOT_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "chunk.h"
+
+/// World state kept in the snapshot besides chunks
+struct WorldMetadata
+{
+    int32_t daylightBrightness;
+};
+
+/*
+    Snapshot of the spawn region, written on clean shutdown so that the next start doesn't need to
+    read or generate these chunks one by one. The file is memory-mapped while it is read and its encoded
+    chunks are handed out without decoding, decoding is left to the time the chunks are actually loaded.
+    Layout: [header][entry table][ChunkCodec payloads...]
+*/
+namespace WorldSnapshot
+{
+    // Write chunks and metadata to `filename` (replaced atomically), return false on failure
+    bool save(const std::string& filename, const WorldMetadata& metadata, const std::vector<const Chunk*>& chunks);
+    // Read a snapshot, `addChunk` is called with each chunk position and its ChunkCodec encoded blocks.
+    // The blocks point into the mapped file and are only valid during the call, keep a copy.
+    // Return the number of chunks read, or -1 if there is no valid snapshot
+    int load(const std::string& filename, WorldMetadata& metadata,
+             const std::function<void(const Vec3i&, const uint8_t*, size_t)>& addChunk);
+}
+
+#endif // !WORLDSNAPSHOT_H_
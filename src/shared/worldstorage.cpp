@@ -0,0 +1,252 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <boost/filesystem/operations.hpp>
+#include "logger.h"
+#include "worldstorage.h"
+
+WorldStorage::WorldStorage(const std::string& path)
+    : m_path(path), m_queuedSerial(0), m_writtenSerial(0), m_batches(0), m_batchFailed(false), m_stop(false),
+      m_bytesWritten(0), m_bytesPerSecond(0.0)
+{
+    m_saveThread = std::thread(&WorldStorage::saveThreadFunc, this);
+}
+
+WorldStorage::~WorldStorage()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_stop = true;
+    }
+    m_queued.notify_one();
+    m_saveThread.join();
+}
+
+RegionFile* WorldStorage::getRegion(const Vec3i& regionPos, bool create)
+{
+    std::lock_guard<std::mutex> lock(m_regionsMutex);
+    auto iter = m_regions.find(regionPos);
+    if (iter != m_regions.end() && (iter->second || !create)) return iter->second.get();
+
+    std::string regionPath = m_path + "region/";
+    std::string filename = regionPath + "r." + std::to_string(regionPos.x) + "." + std::to_string(regionPos.y) + "." +
+                           std::to_string(regionPos.z) + ".nwr";
+    if (create)
+    {
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(regionPath, ec);
+        if (ec) errorstream << "Failed to create directory \"" << regionPath << "\": " << ec.message();
+    }
+    else if (!boost::filesystem::exists(filename))
+    {
+        // Remember missing regions so that loading new chunks won't hit the file system
+        m_regions[regionPos] = nullptr;
+        return nullptr;
+    }
+    std::unique_ptr<RegionFile> region(new RegionFile(filename, create));
+    if (!region->isOpen() && create && boost::filesystem::exists(filename))
+    {
+        // Keep the invalid file for inspection and start a new one, otherwise the region could never be saved again
+        std::string badFilename = filename + "." + std::to_string(std::time(nullptr)) + ".bad";
+        boost::system::error_code ec;
+        boost::filesystem::rename(filename, badFilename, ec);
+        if (ec) errorstream << "Failed to move invalid region file \"" << filename << "\" aside: " << ec.message();
+        else
+        {
+            warningstream << "Moved invalid region file \"" << filename << "\" to \"" << badFilename << "\"";
+            region.reset(new RegionFile(filename, true));
+        }
+    }
+    if (!region->isOpen())
+    {
+        // Saves try to open it again
+        if (create) return nullptr;
+        region = nullptr;
+    }
+    RegionFile* res = region.get();
+    m_regions[regionPos] = std::move(region);
+    return res;
+}
+
+bool WorldStorage::hasChunk(const Vec3i& chunkPos)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        if (m_pending.count(chunkPos) || m_writing.count(chunkPos)) return true;
+    }
+    RegionFile* region = getRegion(RegionFile::getRegionPos(chunkPos), false);
+    return region != nullptr && region->hasChunk(chunkPos);
+}
+
+bool WorldStorage::loadChunk(Chunk& chunk)
+{
+    {
+        // Queued snapshots are newer than what is in the region files
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        auto iter = m_pending.find(chunk.getPosition());
+        if (iter == m_pending.end())
+        {
+            iter = m_writing.find(chunk.getPosition());
+            if (iter == m_writing.end()) iter = m_pending.end();
+        }
+        if (iter != m_pending.end())
+        {
+            const Snapshot& snapshot = iter->second;
+            std::copy(snapshot.blocks.get(), snapshot.blocks.get() + ChunkBlockCount, chunk.getBlocks());
+            chunk.setAttachments(snapshot.attachments != nullptr ?
+                                 std::unique_ptr<ChunkAttachments>(new ChunkAttachments(*snapshot.attachments)) : nullptr);
+            chunk.setDirty(false);
+            return true;
+        }
+    }
+    RegionFile* region = getRegion(RegionFile::getRegionPos(chunk.getPosition()), false);
+    if (region == nullptr || !region->readChunk(chunk)) return false;
+    chunk.setDirty(false);
+    return true;
+}
+
+void WorldStorage::saveChunk(const Chunk& chunk)
+{
+    Snapshot snapshot;
+    snapshot.blocks.reset(new BlockData[ChunkBlockCount]);
+    std::copy(chunk.getBlocks(), chunk.getBlocks() + ChunkBlockCount, snapshot.blocks.get());
+    if (chunk.getAttachments() != nullptr && !chunk.getAttachments()->empty())
+        snapshot.attachments.reset(new ChunkAttachments(*chunk.getAttachments()));
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_pending[chunk.getPosition()] = std::move(snapshot);
+        m_queuedSerial++;
+    }
+    m_queued.notify_one();
+}
+
+bool WorldStorage::flush()
+{
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    uint64_t serial = m_queuedSerial, batches = m_batches;
+    m_written.wait(lock, [this, serial, batches]
+    {
+        return m_writtenSerial >= serial || (m_batches != batches && m_batchFailed);
+    });
+    return m_writtenSerial >= serial;
+}
+
+uint64_t WorldStorage::getQueuedSerial() const
+{
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    return m_queuedSerial;
+}
+
+bool WorldStorage::isWritten(uint64_t serial) const
+{
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    return m_writtenSerial >= serial;
+}
+
+void WorldStorage::prefetch(const Vec3i& chunkPos)
+{
+    RegionFile* region = getRegion(RegionFile::getRegionPos(chunkPos), false);
+    if (region != nullptr) region->prefetch(chunkPos);
+}
+
+size_t WorldStorage::getQueueDepth() const
+{
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    return m_pending.size() + m_writing.size();
+}
+
+void WorldStorage::saveThreadFunc()
+{
+    using Clock = std::chrono::steady_clock;
+    auto windowStart = Clock::now();
+    uint64_t windowBytes = 0;
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    while (true)
+    {
+        // Wake up at least once a second to keep the write rate up to date.
+        // After a failure, wait a second before retrying, unless the storage is closing.
+        if (m_batchFailed) m_queued.wait_for(lock, std::chrono::seconds(1), [this] { return m_stop; });
+        else m_queued.wait_for(lock, std::chrono::seconds(1), [this] { return m_stop || !m_pending.empty(); });
+        if (!m_pending.empty())
+        {
+            m_writing.swap(m_pending);
+            uint64_t serial = m_queuedSerial;
+            lock.unlock();
+            std::vector<Vec3i> failed = writeBatch();
+            lock.lock();
+            // Failed chunks are queued again, unless they were saved again meanwhile
+            for (const Vec3i& pos : failed) m_pending.emplace(pos, std::move(m_writing[pos]));
+            m_writing.clear();
+            // Saves only count as written if the whole batch reached the disk
+            if (failed.empty()) m_writtenSerial = serial;
+            m_batches++;
+            m_batchFailed = !failed.empty();
+            m_written.notify_all();
+        }
+        double elapsed = std::chrono::duration<double>(Clock::now() - windowStart).count();
+        if (elapsed >= 1.0)
+        {
+            uint64_t total = m_bytesWritten;
+            m_bytesPerSecond = (total - windowBytes) / elapsed;
+            windowBytes = total;
+            windowStart = Clock::now();
+        }
+        if (m_stop && (m_pending.empty() || m_batchFailed))
+        {
+            if (!m_pending.empty()) errorstream << "Failed to save " << m_pending.size() << " chunks, dropped";
+            break;
+        }
+    }
+}
+
+std::vector<Vec3i> WorldStorage::writeBatch()
+{
+    std::vector<Vec3i> failed;
+    // m_writing is not modified by other threads until the batch completes
+    std::vector<std::pair<Vec3i, const Snapshot*>> batch;
+    batch.reserve(m_writing.size());
+    for (const auto& item : m_writing) batch.emplace_back(item.first, &item.second);
+    std::stable_sort(batch.begin(), batch.end(), [](const std::pair<Vec3i, const Snapshot*>& lhs,
+                     const std::pair<Vec3i, const Snapshot*>& rhs)
+    {
+        return RegionFile::getRegionPos(lhs.first) < RegionFile::getRegionPos(rhs.first);
+    });
+    for (size_t begin = 0, end; begin < batch.size(); begin = end)
+    {
+        Vec3i regionPos = RegionFile::getRegionPos(batch[begin].first);
+        for (end = begin + 1; end < batch.size() && RegionFile::getRegionPos(batch[end].first) == regionPos; end++);
+        RegionFile* region = getRegion(regionPos, true);
+        bool written = region != nullptr;
+        for (size_t i = begin; i < end && written; i++)
+        {
+            size_t bytes = region->writeChunk(batch[i].first, batch[i].second->blocks.get(), batch[i].second->attachments.get());
+            m_bytesWritten += bytes;
+            written = bytes != 0;
+        }
+        // Chunks written before a failure are written again, so the whole region is retried
+        if (written && region->sync()) continue;
+        errorstream << "Failed to save " << end - begin << " chunks of region (" << regionPos.x << ", " << regionPos.y
+                    << ", " << regionPos.z << "), retrying";
+        for (size_t i = begin; i < end; i++) failed.push_back(batch[i].first);
+    }
+    return failed;
+}
@@ -0,0 +1,121 @@
+/*
+* NEWorld: A free game with similar rules to Minecraft.
+* Copyright (C) 2016 NEWorld Team
+*
+* This file is part of NEWorld.
+* NEWorld is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* NEWorld is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with NEWorld.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WORLDSTORAGE_H_
+#define WORLDSTORAGE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/core/noncopyable.hpp>
+#include "chunk.h"
+#include "regionfile.h"
+
+/// Chunk persistence of a world, backed by region files. Thread-safe.
+/// Saves are write-behind: chunks are snapshotted into a queue and written by a dedicated save thread,
+/// which coalesces repeated saves of a chunk, groups writes by region file and syncs once per batch.
+/// Chunks which fail to be written stay queued and are retried, saves only count as written once they are synced.
+class WorldStorage :boost::noncopyable
+{
+public:
+    /// `path` is the directory of the world save, nothing is created until a chunk is saved
+    explicit WorldStorage(const std::string& path);
+    /// Write all queued chunks and stop the save thread
+    ~WorldStorage();
+
+    /// Get the directory of the world save
+    const std::string& getPath() const
+    {
+        return m_path;
+    }
+
+    /// Is the chunk saved (or queued for saving)
+    bool hasChunk(const Vec3i& chunkPos);
+    /// Load chunk from the save queue or region files (the chunk is not dirty afterwards), return false if it is not saved
+    bool loadChunk(Chunk& chunk);
+    /// Queue a snapshot of the chunk for saving
+    void saveChunk(const Chunk& chunk);
+    /// Wait until all chunks queued so far are written and synced to the disk,
+    /// return false if a batch failed meanwhile (the chunks stay queued)
+    bool flush();
+    /// Get the serial number of the last queued save
+    uint64_t getQueuedSerial() const;
+    /// Are all saves up to `serial` written and synced to the disk
+    bool isWritten(uint64_t serial) const;
+    /// Read ahead a chunk which is expected to be loaded soon
+    void prefetch(const Vec3i& chunkPos);
+
+    /// Get the number of chunks waiting to be written
+    size_t getQueueDepth() const;
+
+    /// Get the write rate of the save thread (bytes per second)
+    double getBytesPerSecond() const
+    {
+        return m_bytesPerSecond;
+    }
+
+private:
+    struct Snapshot
+    {
+        std::unique_ptr<BlockData[]> blocks;
+        /// nullptr if the chunk has no plugin attachments
+        std::unique_ptr<ChunkAttachments> attachments;
+    };
+
+    /// Directory of the world save
+    std::string m_path;
+    /// Opened region files, nullptr for regions known not to exist
+    std::map<Vec3i, std::unique_ptr<RegionFile>> m_regions;
+    /// Protects m_regions
+    std::mutex m_regionsMutex;
+
+    /// Chunks waiting for the next batch, a newer snapshot replaces the older one
+    std::map<Vec3i, Snapshot> m_pending;
+    /// Chunks being written by the save thread, read-only until the batch completes
+    std::map<Vec3i, Snapshot> m_writing;
+    /// Serial numbers of the last queued save and the last save written to the disk
+    uint64_t m_queuedSerial, m_writtenSerial;
+    /// Number of completed batches, and whether the last one failed
+    uint64_t m_batches;
+    bool m_batchFailed;
+    /// Protects m_pending, m_writing, the serial numbers and m_stop
+    mutable std::mutex m_queueMutex;
+    /// Signaled when chunks are queued or the save thread should stop
+    std::condition_variable m_queued;
+    /// Signaled when a batch completes
+    std::condition_variable m_written;
+    bool m_stop;
+    std::atomic<uint64_t> m_bytesWritten;
+    std::atomic<double> m_bytesPerSecond;
+    std::thread m_saveThread;
+
+    /// Get region file by region position, return nullptr if it doesn't exist and `create` is false
+    RegionFile* getRegion(const Vec3i& regionPos, bool create);
+    /// Save thread main loop
+    void saveThreadFunc();
+    /// Write a batch of chunks, one region file at a time, return the chunks which are not synced to the disk
+    std::vector<Vec3i> writeBatch();
+};
+
+#endif // !WORLDSTORAGE_H_
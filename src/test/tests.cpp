@@ -110,6 +110,1675 @@ TEST(Type, get_tests)
     EXPECT_EQ(getString("\"\""),"");
 }
 
+//***********ChunkCodec***********//
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <chunkcodec.h>
+
+namespace
+{
+    // Rock below a rolling heightmap, lit air above
+    void makeTerrainChunk(BlockData* blocks)
+    {
+        for (int x = 0; x < ChunkSize; x++)
+            for (int z = 0; z < ChunkSize; z++)
+            {
+                int height = int(16 + 6 * sin(x / 5.0) * cos(z / 7.0));
+                for (int y = 0; y < ChunkSize; y++)
+                    blocks[x * ChunkSize * ChunkSize + y * ChunkSize + z] = y <= height ? BlockData(1, 0, 0) : BlockData(0, 15, 0);
+            }
+    }
+
+    bool sameBlocks(const BlockData* a, const BlockData* b)
+    {
+        for (int i = 0; i < ChunkBlockCount; i++)
+            if (a[i].getRawData() != b[i].getRawData()) return false;
+        return true;
+    }
+}
+
+TEST(ChunkCodec, RoundTripFuzz)
+{
+    std::mt19937 rng(20161018);
+    std::vector<BlockData> blocks(ChunkBlockCount), decoded(ChunkBlockCount);
+    for (uint32_t kinds : { 1u, 2u, 3u, 5u, 16u, 17u, 33u, 300u, 5000u, 32768u })
+        for (int maxRun : { 1, 7, 100, 4000 })
+        {
+            std::vector<uint32_t> palette(kinds);
+            for (auto& word : palette) word = rng();
+            for (int i = 0; i < ChunkBlockCount;)
+            {
+                uint32_t word = palette[rng() % kinds];
+                for (int run = rng() % maxRun + 1; run > 0 && i < ChunkBlockCount; run--, i++)
+                    blocks[i] = BlockData::fromRawData(word);
+            }
+            std::vector<uint8_t> encoded;
+            ChunkCodec::encode(blocks.data(), encoded);
+            ASSERT_EQ(ChunkCodec::decode(encoded.data(), encoded.size(), decoded.data()), encoded.size());
+            EXPECT_TRUE(sameBlocks(blocks.data(), decoded.data()));
+
+            // Malformed input must be rejected or decoded within bounds, never crash
+            for (int i = 0; i < 64; i++)
+            {
+                std::vector<uint8_t> broken(encoded.begin(), encoded.begin() + rng() % (encoded.size() + 1));
+                if (!broken.empty() && rng() % 2) broken[rng() % broken.size()] ^= uint8_t(1 << rng() % 8);
+                EXPECT_LE(ChunkCodec::decode(broken.data(), broken.size(), decoded.data()), broken.size());
+            }
+        }
+}
+
+TEST(ChunkCodec, TerrainRatioAndThroughput)
+{
+    std::vector<BlockData> blocks(ChunkBlockCount), decoded(ChunkBlockCount);
+    makeTerrainChunk(blocks.data());
+    std::vector<uint8_t> encoded;
+    ChunkCodec::encode(blocks.data(), encoded);
+    double ratio = double(ChunkBlockCount * sizeof(BlockData)) / encoded.size();
+    EXPECT_GE(ratio, 20.0);
+
+    constexpr int Rounds = 2000;
+    using Clock = std::chrono::steady_clock;
+    auto begin = Clock::now();
+    for (int i = 0; i < Rounds; i++)
+        ASSERT_EQ(ChunkCodec::decode(encoded.data(), encoded.size(), decoded.data()), encoded.size());
+    double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    EXPECT_TRUE(sameBlocks(blocks.data(), decoded.data()));
+    std::cout << "[ ChunkCodec ] terrain ratio " << ratio << "x, decode "
+              << Rounds * ChunkBlockCount * sizeof(BlockData) / seconds / 1e9 << " GB/s" << std::endl;
+}
+
+//***********ChunkCache***********//
+#include <chunkcache.h>
+TEST(ChunkCache, LruBudgetAndCounters)
+{
+    Chunk chunk(Vec3i(0, 0, 0));
+    makeTerrainChunk(chunk.getBlocks());
+    ChunkCache cache;
+    cache.put(chunk);
+    size_t chunkSize = cache.getSize();
+    EXPECT_GT(chunkSize, 0u);
+    cache.setBudget(chunkSize * 3);
+    for (int i = 1; i < 5; i++)
+    {
+        Chunk other(Vec3i(i, 0, 0));
+        makeTerrainChunk(other.getBlocks());
+        cache.put(other);
+    }
+    // Only the 3 most recently unloaded chunks are kept
+    EXPECT_EQ(cache.getChunkCount(), 3u);
+    EXPECT_LE(cache.getSize(), cache.getBudget());
+
+    Chunk restored(Vec3i(4, 0, 0)), evicted(Vec3i(0, 0, 0));
+    EXPECT_TRUE(cache.take(restored));
+    EXPECT_TRUE(sameBlocks(chunk.getBlocks(), restored.getBlocks()));
+    EXPECT_FALSE(cache.take(restored)); // Taken chunks leave the cache
+    EXPECT_FALSE(cache.take(evicted));
+    EXPECT_EQ(cache.getHits(), 1u);
+    EXPECT_EQ(cache.getMisses(), 2u);
+    EXPECT_EQ(cache.getChunkCount(), 2u);
+}
+
+//***********RegionFile***********//
+#include <boost/filesystem/operations.hpp>
+#include <regionfile.h>
+// Saving chunks again and again reuses the space of replaced payloads, except payloads chunks still use
+TEST(RegionFile, ReusesReplacedPayloads)
+{
+    constexpr uint64_t RawSize = ChunkBlockCount * sizeof(BlockData);
+    std::string filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string() + ".nwr";
+    // Random blocks don't compress, so they are stored raw
+    std::mt19937 rng(20161018);
+    std::vector<BlockData> noise(ChunkBlockCount), otherNoise(ChunkBlockCount), terrain(ChunkBlockCount);
+    for (auto& block : noise) block = BlockData::fromRawData(rng());
+    for (auto& block : otherNoise) block = BlockData::fromRawData(rng());
+    makeTerrainChunk(terrain.data());
+    uint64_t settledSize;
+    {
+        RegionFile region(filename, true);
+        ASSERT_TRUE(region.isOpen());
+        for (int round = 0; round < 100; round++)
+        {
+            for (int i = 0; i < 4; i++)
+                region.writeChunk(Vec3i(i, 0, 0), (round + i) % 2 ? noise.data() : terrain.data());
+            region.sync();
+        }
+        // Appending would have taken 200 raw payloads
+        settledSize = boost::filesystem::file_size(filename);
+        EXPECT_LE(settledSize, 10 * RawSize);
+
+        Chunk adopted(Vec3i(0, 0, 0));
+        ASSERT_TRUE(region.readChunk(adopted));
+        EXPECT_TRUE(sameBlocks(adopted.getBlocks(), noise.data()));
+        for (int round = 0; round < 10; round++)
+        {
+            for (int i = 0; i < 4; i++) region.writeChunk(Vec3i(i, 0, 0), otherNoise.data());
+            region.sync();
+        }
+        EXPECT_TRUE(sameBlocks(adopted.getBlocks(), noise.data()));
+    }
+    {
+        // Space between the payloads is found again when the file is opened
+        RegionFile region(filename, false);
+        ASSERT_TRUE(region.isOpen());
+        uint64_t size = boost::filesystem::file_size(filename);
+        for (int i = 0; i < 4; i++) region.writeChunk(Vec3i(i, 0, 0), noise.data());
+        region.sync();
+        EXPECT_EQ(boost::filesystem::file_size(filename), size);
+        Chunk chunk(Vec3i(3, 0, 0));
+        ASSERT_TRUE(region.readChunk(chunk));
+        EXPECT_TRUE(sameBlocks(chunk.getBlocks(), noise.data()));
+    }
+    boost::system::error_code ec;
+    boost::filesystem::remove(filename, ec);
+}
+
+//***********ChunkAttachments***********//
+#include <map>
+#include <random>
+#include <boost/filesystem/operations.hpp>
+#include <worldstorage.h>
+TEST(ChunkAttachments, FlatTableAndRoundTrip)
+{
+    // Random edits checked against std::map, with enough keys to grow the table and collide
+    ChunkAttachments attachments;
+    std::map<std::pair<uint32_t, int>, std::vector<uint8_t>> reference;
+    std::mt19937 rng(42);
+    for (int i = 0; i < 20000; i++)
+    {
+        uint32_t plugin = rng() % 3;
+        int index = int(rng() % 512) * 61;
+        std::vector<uint8_t> data(rng() % 4);
+        for (uint8_t& byte : data) byte = uint8_t(rng());
+        attachments.set(plugin, index, data.data(), data.size());
+        if (data.empty()) reference.erase({ plugin, index });
+        else reference[{ plugin, index }] = data;
+    }
+    ASSERT_EQ(attachments.size(), reference.size());
+    for (const auto& item : reference)
+    {
+        const std::vector<uint8_t>* data = attachments.get(item.first.first, item.first.second);
+        ASSERT_NE(data, nullptr);
+        EXPECT_EQ(*data, item.second);
+    }
+    EXPECT_EQ(attachments.get(7, 0), nullptr);
+
+    std::vector<uint8_t> serialized;
+    attachments.serialize(serialized);
+    ChunkAttachments restored;
+    ASSERT_TRUE(restored.deserialize(serialized.data(), serialized.size()));
+    std::vector<uint8_t> again;
+    restored.serialize(again);
+    EXPECT_EQ(serialized, again);
+    EXPECT_FALSE(restored.deserialize(serialized.data(), serialized.size() - 1));
+
+    // Chunks without attachments don't pay for them, chunks with attachments keep them through the region files
+    std::string path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string() + "/";
+    const uint8_t note[] = { 1, 2, 3 };
+    {
+        WorldStorage storage(path);
+        Chunk plain(Vec3i(0, 0, 0)), attached(Vec3i(1, 0, 0));
+        makeTerrainChunk(plain.getBlocks());
+        makeTerrainChunk(attached.getBlocks());
+        attached.getOrCreateAttachments().set(getAttachmentPluginID("test"), Chunk::getBlockIndex(Vec3i(1, 2, 3)),
+                                              note, sizeof(note));
+        EXPECT_EQ(plain.getAttachments(), nullptr);
+        storage.saveChunk(plain);
+        storage.saveChunk(attached);
+        storage.flush();
+    }
+    {
+        WorldStorage storage(path);
+        Chunk plain(Vec3i(0, 0, 0)), attached(Vec3i(1, 0, 0));
+        ASSERT_TRUE(storage.loadChunk(plain));
+        ASSERT_TRUE(storage.loadChunk(attached));
+        EXPECT_EQ(plain.getAttachments(), nullptr);
+        ASSERT_NE(attached.getAttachments(), nullptr);
+        const std::vector<uint8_t>* data = attached.getAttachments()->get(getAttachmentPluginID("test"),
+                                                                          Chunk::getBlockIndex(Vec3i(1, 2, 3)));
+        ASSERT_NE(data, nullptr);
+        EXPECT_EQ(*data, std::vector<uint8_t>(note, note + sizeof(note)));
+        EXPECT_TRUE(sameBlocks(plain.getBlocks(), attached.getBlocks()));
+    }
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(path, ec);
+}
+
+//***********WorldStorage***********//
+#include <fstream>
+TEST(WorldStorage, FailedSavesStayQueued)
+{
+    std::string path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string() + "/";
+    boost::filesystem::create_directories(path);
+    // A file in place of the region directory makes every region write fail
+    std::ofstream(path + "region") << "not a directory";
+    Chunk chunk(Vec3i(0, 0, 0));
+    makeTerrainChunk(chunk.getBlocks());
+    {
+        WorldStorage storage(path);
+        storage.saveChunk(chunk);
+        uint64_t serial = storage.getQueuedSerial();
+        EXPECT_FALSE(storage.flush());
+        EXPECT_FALSE(storage.isWritten(serial));
+        EXPECT_TRUE(storage.hasChunk(chunk.getPosition()));
+        Chunk queued(chunk.getPosition());
+        ASSERT_TRUE(storage.loadChunk(queued));
+        EXPECT_TRUE(sameBlocks(queued.getBlocks(), chunk.getBlocks()));
+
+        // Retried until the region can be written
+        boost::filesystem::remove(path + "region");
+        bool written = false;
+        for (int i = 0; i < 3 && !written; i++) written = storage.flush();
+        EXPECT_TRUE(written);
+        EXPECT_TRUE(storage.isWritten(serial));
+    }
+    {
+        WorldStorage storage(path);
+        Chunk loaded(chunk.getPosition());
+        ASSERT_TRUE(storage.loadChunk(loaded));
+        EXPECT_TRUE(sameBlocks(loaded.getBlocks(), chunk.getBlocks()));
+    }
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(path, ec);
+}
+
+//***********WorldSnapshot***********//
+#include <worldsnapshot.h>
+namespace
+{
+    std::vector<char> readFile(const std::string& filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    void writeFile(const std::string& filename, const std::vector<char>& bytes)
+    {
+        std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+        file.write(bytes.data(), std::streamsize(bytes.size()));
+    }
+
+    // Load a snapshot into `chunks`, return what load() returns
+    int loadSnapshot(const std::string& filename, WorldMetadata& metadata, std::map<Vec3i, std::vector<uint8_t>>& chunks)
+    {
+        chunks.clear();
+        return WorldSnapshot::load(filename, metadata, [&](const Vec3i& pos, const uint8_t* data, size_t length)
+        {
+            chunks[pos].assign(data, data + length);
+        });
+    }
+}
+
+TEST(WorldSnapshot, RoundTripAndRejectsDamage)
+{
+    namespace fs = boost::filesystem;
+    fs::path dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(dir);
+    const std::string filename = (dir / "spawn.snapshot").string(), temp = filename + ".tmp";
+    {
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        std::vector<const Chunk*> pointers;
+        for (const Vec3i& pos : { Vec3i(0, 0, 0), Vec3i(-1, 2, 3), Vec3i(5, -4, 1) })
+        {
+            chunks.emplace_back(new Chunk(pos));
+            makeTerrainChunk(chunks.back()->getBlocks());
+            chunks.back()->getBlocks()[chunks.size()] = BlockData(uint32_t(chunks.size()) + 2, 0, 0);
+            pointers.push_back(chunks.back().get());
+        }
+        // A temporary file left by a crashed save is replaced
+        writeFile(temp, std::vector<char>(100, 'x'));
+        ASSERT_TRUE(WorldSnapshot::save(filename, WorldMetadata{ 11 }, pointers));
+        EXPECT_FALSE(fs::exists(temp));
+
+        WorldMetadata metadata{ 0 };
+        std::map<Vec3i, std::vector<uint8_t>> loaded;
+        ASSERT_EQ(loadSnapshot(filename, metadata, loaded), 3);
+        EXPECT_EQ(metadata.daylightBrightness, 11);
+        for (const auto& chunk : chunks)
+        {
+            const std::vector<uint8_t>& data = loaded[chunk->getPosition()];
+            Chunk decoded(chunk->getPosition());
+            ASSERT_TRUE(ChunkCodec::decode(data.data(), data.size(), decoded));
+            EXPECT_TRUE(sameBlocks(chunk->getBlocks(), decoded.getBlocks()));
+        }
+
+        // A save which can't write its temporary file leaves the old snapshot
+        fs::create_directory(temp);
+        fs::create_directory(fs::path(temp) / "busy");
+        EXPECT_FALSE(WorldSnapshot::save(filename, WorldMetadata{ 3 }, {}));
+        EXPECT_EQ(loadSnapshot(filename, metadata, loaded), 3);
+        EXPECT_EQ(metadata.daylightBrightness, 11);
+        fs::remove_all(temp);
+    }
+
+    // Truncated and corrupt snapshots are ignored as a whole
+    const std::vector<char> good = readFile(filename);
+    const std::string damaged = (dir / "damaged.snapshot").string();
+    std::vector<std::vector<char>> variants;
+    for (size_t length : { size_t(0), size_t(7), size_t(20), size_t(60), good.size() / 2, good.size() - 1 })
+        variants.emplace_back(good.begin(), good.begin() + length);
+    variants.push_back(good);
+    variants.back()[0] ^= 1; // Magic
+    variants.push_back(good);
+    variants.back()[4] ^= 1; // Version
+    variants.push_back(good);
+    variants.back()[16 + 16 + 7] = char(0x80); // Offset of the first entry, past the end
+    for (const auto& bytes : variants)
+    {
+        writeFile(damaged, bytes);
+        WorldMetadata metadata{ 0 };
+        std::map<Vec3i, std::vector<uint8_t>> loaded;
+        EXPECT_EQ(loadSnapshot(damaged, metadata, loaded), -1);
+        EXPECT_TRUE(loaded.empty());
+        EXPECT_EQ(metadata.daylightBrightness, 0);
+    }
+    WorldMetadata metadata;
+    std::map<Vec3i, std::vector<uint8_t>> loaded;
+    EXPECT_EQ(loadSnapshot((dir / "missing.snapshot").string(), metadata, loaded), -1);
+    fs::remove_all(dir);
+}
+
+//***********BlockJournal***********//
+#include <common.h>
+#ifndef NEWORLD_TARGET_WINDOWS
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/filesystem/operations.hpp>
+#include <blockjournal.h>
+
+namespace
+{
+    // Edit i writes a distinct block, so that every acknowledged edit can be checked after replay
+    Vec3i getEditPos(uint64_t i)
+    {
+        int chunk = int(i / ChunkBlockCount), block = int(i % ChunkBlockCount);
+        return Vec3i(chunk * ChunkSize + block / (ChunkSize * ChunkSize), block / ChunkSize % ChunkSize, block % ChunkSize);
+    }
+
+    BlockData getEditBlock(uint64_t i)
+    {
+        return BlockData::fromRawData(uint32_t(i * 2654435761u) | 1);
+    }
+}
+
+// Edit at a sustained 100k edits/sec in a child process, kill it and check that no acknowledged edit is lost
+TEST(BlockJournal, CrashKeepsAcknowledgedEdits)
+{
+    constexpr int EditsPerSecond = 100000, EditsPerTick = 1000, SavedChunks = 2;
+    constexpr double CrashAfter = 1.5;
+    std::string path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string() + "/";
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0)
+    {
+        close(fds[0]);
+        WorldStorage storage(path);
+        // Some chunks are saved before editing, the rest only exist in the journal
+        for (int i = 0; i < SavedChunks; i++) storage.saveChunk(Chunk(Vec3i(i, 0, 0)));
+        storage.flush();
+        BlockJournal journal(storage);
+        using Clock = std::chrono::steady_clock;
+        auto begin = Clock::now();
+        for (uint64_t i = 0; ; i += EditsPerTick)
+        {
+            uint64_t seq = 0;
+            for (uint64_t j = i; j < i + EditsPerTick; j++) seq = journal.append(getEditPos(j), getEditBlock(j));
+            if (!journal.waitDurable(seq)) _exit(1);
+            uint64_t acknowledged = i + EditsPerTick;
+            if (write(fds[1], &acknowledged, sizeof(acknowledged)) != sizeof(acknowledged)) _exit(1);
+            std::this_thread::sleep_until(begin + std::chrono::microseconds(acknowledged * 1000000 / EditsPerSecond));
+        }
+    }
+    close(fds[1]);
+
+    using Clock = std::chrono::steady_clock;
+    auto begin = Clock::now();
+    uint64_t acknowledged = 0, value;
+    while (std::chrono::duration<double>(Clock::now() - begin).count() < CrashAfter &&
+           read(fds[0], &value, sizeof(value)) == sizeof(value))
+        acknowledged = value;
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+    close(fds[0]);
+    std::cout << "[ BlockJournal ] " << acknowledged << " edits acknowledged before the crash" << std::endl;
+    EXPECT_GE(acknowledged, uint64_t(EditsPerSecond * CrashAfter * 0.9));
+
+    {
+        WorldStorage storage(path);
+        BlockJournal journal(storage);
+        uint64_t lost = 0;
+        int chunks = int((acknowledged + ChunkBlockCount - 1) / ChunkBlockCount);
+        for (int c = 0; c < chunks; c++)
+        {
+            Chunk chunk(Vec3i(c, 0, 0));
+            EXPECT_EQ(storage.loadChunk(chunk), c < SavedChunks);
+            if (c >= SavedChunks) journal.applyOrphans(chunk);
+            for (uint64_t i = uint64_t(c) * ChunkBlockCount; i < std::min(acknowledged, uint64_t(c + 1) * ChunkBlockCount); i++)
+                if (chunk.getBlock(getEditPos(i) - chunk.getPosition() * ChunkSize).getRawData() != getEditBlock(i).getRawData())
+                    lost++;
+        }
+        EXPECT_EQ(lost, 0u);
+    }
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(path, ec);
+}
+
+// Journal segments are only retired by chunk saves which reached the disk
+TEST(BlockJournal, FailedSavesKeepSegments)
+{
+    constexpr uint64_t Edits = 1000;
+    std::string path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string() + "/";
+    boost::filesystem::create_directories(path);
+    // A file in place of the region directory makes every region write fail
+    std::ofstream(path + "region") << "not a directory";
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0)
+    {
+        close(fds[0]);
+        WorldStorage storage(path);
+        BlockJournal journal(storage);
+        Chunk chunk(Vec3i(0, 0, 0));
+        uint64_t seq = 0;
+        for (uint64_t i = 0; i < Edits; i++)
+        {
+            seq = journal.append(getEditPos(i), getEditBlock(i));
+            chunk.setBlock(getEditPos(i), getEditBlock(i));
+        }
+        if (!journal.waitDurable(seq)) _exit(1);
+        // The save fails, the checkpoint must keep the old segment
+        storage.saveChunk(chunk);
+        journal.checkpoint();
+        if (storage.flush()) _exit(1);
+        // Long enough for the journal to retire segments
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        char done = 1;
+        if (write(fds[1], &done, 1) != 1) _exit(1);
+        pause();
+    }
+    close(fds[1]);
+    char done = 0;
+    EXPECT_EQ(read(fds[0], &done, 1), 1);
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+    close(fds[0]);
+    ASSERT_EQ(done, 1);
+
+    boost::filesystem::remove(path + "region");
+    {
+        WorldStorage storage(path);
+        BlockJournal journal(storage);
+        Chunk chunk(Vec3i(0, 0, 0));
+        EXPECT_FALSE(storage.loadChunk(chunk));
+        journal.applyOrphans(chunk);
+        uint64_t lost = 0;
+        for (uint64_t i = 0; i < Edits; i++)
+            if (chunk.getBlock(getEditPos(i)).getRawData() != getEditBlock(i).getRawData()) lost++;
+        EXPECT_EQ(lost, 0u);
+    }
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(path, ec);
+}
+#endif
+
+//***********Noise***********//
+#include <cstring>
+#include "../main/noise.h"
+TEST(Noise, GridMatchesScalar)
+{
+    using WorldGen::NoiseGridSize;
+    const int origins[][2] = { { 0, 0 }, { 32, -32 }, { -1000, 777 }, { -65, -4097 }, { 123456, -98765 } };
+    double grid[NoiseGridSize * NoiseGridSize], scalar[NoiseGridSize * NoiseGridSize];
+    for (const auto& origin : origins)
+    {
+        WorldGen::PerlinNoise2DGrid(origin[0], origin[1], grid);
+        for (int i = 0; i < NoiseGridSize; i++)
+            for (int j = 0; j < NoiseGridSize; j++)
+                scalar[i * NoiseGridSize + j] = WorldGen::PerlinNoise2D((origin[0] + i) / WorldGen::NoiseScaleX,
+                                                                       (origin[1] + j) / WorldGen::NoiseScaleZ);
+        EXPECT_EQ(memcmp(grid, scalar, sizeof(grid)), 0) << "at " << origin[0] << ", " << origin[1];
+    }
+}
+
+TEST(Noise, GridThroughput)
+{
+    using WorldGen::NoiseGridSize;
+    constexpr int Grids = 400;
+    using Clock = std::chrono::steady_clock;
+    int heights[NoiseGridSize * NoiseGridSize];
+    long long checksum[2] = {};
+
+    auto begin = Clock::now();
+    for (int g = 0; g < Grids; g++)
+        for (int i = 0; i < NoiseGridSize; i++)
+            for (int j = 0; j < NoiseGridSize; j++)
+                checksum[0] += WorldGen::getHeight(g * NoiseGridSize + i, j);
+    double scalarSeconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    begin = Clock::now();
+    for (int g = 0; g < Grids; g++)
+    {
+        WorldGen::getHeightGrid(g * NoiseGridSize, 0, heights);
+        for (int h : heights) checksum[1] += h;
+    }
+    double gridSeconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    EXPECT_EQ(checksum[0], checksum[1]);
+    double columns = double(Grids) * NoiseGridSize * NoiseGridSize;
+    std::cout << "[ Noise ] scalar " << columns / scalarSeconds / 1e6 << "M columns/s, grid ("
+              << WorldGen::getNoiseInstructionSet() << ") " << columns / gridSeconds / 1e6 << "M columns/s" << std::endl;
+}
+
+//***********HeightmapCache***********//
+#include <thread>
+#include "../main/heightmapcache.h"
+TEST(HeightmapCache, SharedColumnsAndLru)
+{
+    using WorldGen::NoiseGridSize;
+    HeightmapCache cache(2);
+    auto column = cache.get(-3, 5);
+    int heights[NoiseGridSize * NoiseGridSize];
+    WorldGen::getHeightGrid(-3 * NoiseGridSize, 5 * NoiseGridSize, heights);
+    EXPECT_EQ(memcmp(column->heights, heights, sizeof(heights)), 0);
+    EXPECT_EQ(column->minHeight, *std::min_element(heights, heights + NoiseGridSize * NoiseGridSize));
+    EXPECT_EQ(cache.getSurfaceHeight(-3 * NoiseGridSize + 1, 5 * NoiseGridSize + 2), heights[1 * NoiseGridSize + 2]);
+    EXPECT_EQ(cache.get(-3, 5), column);
+    EXPECT_EQ(cache.getHits(), 2u);
+    EXPECT_EQ(cache.getMisses(), 1u);
+
+    cache.get(0, 0);
+    cache.get(-3, 5);
+    cache.get(1, 0); // Evicts (0, 0)
+    EXPECT_EQ(cache.getColumnCount(), 2u);
+    EXPECT_EQ(cache.get(-3, 5), column);
+    EXPECT_EQ(cache.getMisses(), 3u);
+    cache.get(0, 0);
+    EXPECT_EQ(cache.getMisses(), 4u);
+
+    // A column generated by many threads at once is computed only once
+    HeightmapCache shared;
+    std::vector<std::thread> threads;
+    std::vector<const HeightmapColumn*> results(8);
+    for (size_t i = 0; i < results.size(); i++)
+        threads.emplace_back([&shared, &results, i] { results[i] = shared.get(7, 7).get(); });
+    for (auto& thread : threads) thread.join();
+    EXPECT_EQ(shared.getMisses(), 1u);
+    EXPECT_EQ(std::count(results.begin(), results.end(), results[0]), std::ptrdiff_t(results.size()));
+}
+
+//***********Density***********//
+#include "../main/density.h"
+namespace
+{
+    // Straightforward trilinear interpolation of the lattice, same operation order as the generator
+    void interpolateReference(const NWvec3i& pos, const HeightmapColumn& column, NWblockdata solid, NWblockdata empty,
+                              NWblockdata* blocks)
+    {
+        using namespace WorldGen;
+        float lattice[DensityLatticeSize * DensityLatticeSize * DensityLatticeSize];
+        getDensityLattice(pos, lattice);
+        auto at = [&lattice](int i, int j, int k) { return lattice[(i * DensityLatticeSize + j) * DensityLatticeSize + k]; };
+        for (int x = 0; x < NoiseGridSize; x++)
+            for (int y = 0; y < NoiseGridSize; y++)
+                for (int z = 0; z < NoiseGridSize; z++)
+                {
+                    int i = x / DensityCellSize, j = y / DensityCellSize, k = z / DensityCellSize;
+                    float fx = x % DensityCellSize * 0.25f, fy = y % DensityCellSize * 0.25f, fz = z % DensityCellSize * 0.25f;
+                    float a00 = at(i, j, k) + (at(i + 1, j, k) - at(i, j, k))*fx;
+                    float a10 = at(i, j + 1, k) + (at(i + 1, j + 1, k) - at(i, j + 1, k))*fx;
+                    float a01 = at(i, j, k + 1) + (at(i + 1, j, k + 1) - at(i, j, k + 1))*fx;
+                    float a11 = at(i, j + 1, k + 1) + (at(i + 1, j + 1, k + 1) - at(i, j + 1, k + 1))*fx;
+                    float b0 = a00 + (a10 - a00)*fy, b1 = a01 + (a11 - a01)*fy;
+                    float density = float(column.heights[x * NoiseGridSize + z] + 1 - pos.y * NoiseGridSize - y) + (b0 + (b1 - b0)*fz);
+                    blocks[(x * NoiseGridSize + y) * NoiseGridSize + z] = density > 0.0f ? solid : empty;
+                }
+    }
+
+    uint32_t blockWord(NWblockdata block)
+    {
+        uint32_t word;
+        memcpy(&word, &block, sizeof(word));
+        return word;
+    }
+}
+
+TEST(Density, LatticeMatchesReferenceAndBenchmark)
+{
+    using WorldGen::NoiseGridSize;
+    constexpr int BlockCount = NoiseGridSize * NoiseGridSize * NoiseGridSize;
+    NWblockdata solid, empty;
+    solid.id = 1;
+    solid.brightness = solid.state = 0;
+    empty.id = 0;
+    empty.brightness = 15;
+    empty.state = 0;
+    HeightmapCache heightmaps;
+    std::vector<NWblockdata> fast(BlockCount), reference(BlockCount), naive(BlockCount);
+
+    // Surface chunks, where neither bulk path applies to the whole chunk
+    std::vector<NWvec3i> chunks;
+    for (int x = -2; x < 2; x++)
+        for (int z = -2; z < 2; z++)
+        {
+            auto column = heightmaps.get(x, z);
+            for (int y = (column->minHeight - 16) >> 5; y <= (column->maxHeight + 16) >> 5; y++)
+                chunks.push_back(NWvec3i{ x, y, z });
+        }
+
+    size_t mismatches = 0, differences = 0;
+    for (const NWvec3i& pos : chunks)
+    {
+        auto column = heightmaps.get(pos.x, pos.z);
+        WorldGen::generateDensityChunk(pos, *column, solid, empty, fast.data());
+        interpolateReference(pos, *column, solid, empty, reference.data());
+        WorldGen::generateDensityChunkNaive(pos, *column, solid, empty, naive.data());
+        for (int i = 0; i < BlockCount; i++)
+        {
+            if (blockWord(fast[i]) != blockWord(reference[i])) mismatches++;
+            if (blockWord(fast[i]) != blockWord(naive[i])) differences++;
+        }
+    }
+    EXPECT_EQ(mismatches, 0u);
+    // Interpolation only smooths the noise, the terrain should stay the same
+    double agreement = 1.0 - double(differences) / (double(chunks.size()) * BlockCount);
+    EXPECT_GT(agreement, 0.95);
+
+    using Clock = std::chrono::steady_clock;
+    auto begin = Clock::now();
+    for (const NWvec3i& pos : chunks)
+        WorldGen::generateDensityChunkNaive(pos, *heightmaps.get(pos.x, pos.z), solid, empty, naive.data());
+    double naiveSeconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    constexpr int Rounds = 20;
+    begin = Clock::now();
+    for (int r = 0; r < Rounds; r++)
+        for (const NWvec3i& pos : chunks)
+            WorldGen::generateDensityChunk(pos, *heightmaps.get(pos.x, pos.z), solid, empty, fast.data());
+    double fastSeconds = std::chrono::duration<double>(Clock::now() - begin).count() / Rounds;
+    std::cout << "[ Density ] " << chunks.size() << " surface chunks, agreement with per-block noise " << agreement * 100
+              << "%, per-block " << chunks.size() / naiveSeconds << " chunks/s, lattice "
+              << chunks.size() / fastSeconds << " chunks/s" << std::endl;
+    EXPECT_LT(fastSeconds, naiveSeconds);
+}
+
+//***********GenerationPipeline***********//
+#include <atomic>
+#include <generationpipeline.h>
+namespace
+{
+    std::atomic<int> pipelineViolations(0);
+
+    // Each stage checks that its neighbours completed the previous stage, then marks its chunk with the stage
+    template <int Stage>
+    void markStage(GenerationContext& context)
+    {
+        int radius = context.getRadius();
+        for (int x = -radius; x <= radius; x++)
+            for (int y = -radius; y <= radius; y++)
+                for (int z = -radius; z <= radius; z++)
+                    if (int(context.getNeighbour(Vec3i(x, y, z)).getBlock(Vec3i(0, 0, 0)).getID()) < Stage)
+                        pipelineViolations++;
+        context.getChunk().setBlock(Vec3i(0, 0, 0), BlockData(Stage + 1, 0, 0));
+    }
+
+    void decorate(GenerationContext& context)
+    {
+        markStage<int(GenerationStage::Decoration)>(context);
+        // Something crossing the border to the next chunk
+        context.setBlock(context.getChunk().getPosition() * ChunkSize + Vec3i(ChunkSize + 1, 1, 1), BlockData(100, 0, 0));
+    }
+}
+
+TEST(GenerationPipeline, StagesWaitForNeighbours)
+{
+    GenerationPipeline pipeline;
+    EXPECT_EQ(pipeline.getStageRadius(GenerationStage::Terrain), 0);
+    pipeline.setStage(GenerationStage::Terrain, markStage<int(GenerationStage::Terrain)>, 0);
+    pipeline.setStage(GenerationStage::Carving, markStage<int(GenerationStage::Carving)>, 0);
+    pipeline.setStage(GenerationStage::Decoration, decorate, 1);
+    pipeline.setStage(GenerationStage::Lighting, markStage<int(GenerationStage::Lighting)>, 1);
+    // Nothing prepares neighbours for the first stage
+    EXPECT_FALSE(pipeline.setStage(GenerationStage::Terrain, markStage<int(GenerationStage::Terrain)>, 1));
+    EXPECT_EQ(pipeline.getStageRadius(GenerationStage::Terrain), 0);
+
+    ThreadPool pool(4);
+    std::vector<Vec3i> targets;
+    for (int x = -1; x <= 1; x++)
+        for (int y = -1; y <= 1; y++)
+            for (int z = -1; z <= 1; z++)
+                targets.push_back(Vec3i(x, y, z));
+    pipeline.generate(targets, pool, 15);
+    EXPECT_EQ(pipelineViolations, 0);
+    // Lighting needs decorated neighbours, which need carved neighbours
+    EXPECT_EQ(pipeline.getChunkCount(), size_t(7 * 7 * 7));
+
+    for (const Vec3i& pos : targets)
+    {
+        Chunk chunk(pos);
+        ASSERT_TRUE(pipeline.take(chunk));
+        EXPECT_EQ(chunk.getBlock(Vec3i(0, 0, 0)).getID(), GenerationStageCount);
+        EXPECT_EQ(chunk.getBlock(Vec3i(1, 1, 1)).getID(), 100);
+    }
+    Chunk partial(Vec3i(2, 0, 0));
+    EXPECT_FALSE(pipeline.take(partial));
+
+    // Partially generated neighbours are reused by the next request
+    pipeline.generate(std::vector<Vec3i>{ Vec3i(2, 0, 0) }, pool, 15);
+    EXPECT_EQ(pipelineViolations, 0);
+    EXPECT_TRUE(pipeline.take(partial));
+    EXPECT_EQ(pipeline.getLateWriteCount(), size_t(0));
+}
+
+TEST(GenerationPipeline, IgnoresOtherPoolTasks)
+{
+    GenerationPipeline pipeline;
+    pipeline.setStage(GenerationStage::Terrain, markStage<int(GenerationStage::Terrain)>, 0);
+    pipeline.setStage(GenerationStage::Carving, markStage<int(GenerationStage::Carving)>, 0);
+    pipeline.setStage(GenerationStage::Decoration, decorate, 1);
+    pipeline.setStage(GenerationStage::Lighting, markStage<int(GenerationStage::Lighting)>, 1);
+    ThreadPool pool(2);
+    // Another user of the pool keeps a worker busy until the pipeline is done
+    std::mutex mutex;
+    std::condition_variable released;
+    bool done = false;
+    pool.post([&]()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        released.wait(lock, [&] { return done; });
+    });
+    Chunk chunk(Vec3i(0, 0, 0));
+    pipeline.generate(std::vector<Vec3i>{ chunk.getPosition() }, pool, 15);
+    EXPECT_TRUE(pipeline.take(chunk));
+    EXPECT_EQ(pipelineViolations, 0);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    released.notify_all();
+    pool.wait();
+}
+
+TEST(GenerationPipeline, ReportsLateWrites)
+{
+    // Lighting doesn't wait for decorated neighbours, so decorations may reach chunks which are done
+    GenerationPipeline pipeline;
+    pipeline.setStage(GenerationStage::Terrain, markStage<int(GenerationStage::Terrain)>, 0);
+    pipeline.setStage(GenerationStage::Carving, markStage<int(GenerationStage::Carving)>, 0);
+    pipeline.setStage(GenerationStage::Decoration, decorate, 1);
+    pipeline.setStage(GenerationStage::Lighting, markStage<int(GenerationStage::Lighting)>, 0);
+
+    ThreadPool pool(2);
+    pipeline.generate(std::vector<Vec3i>{ Vec3i(1, 0, 0) }, pool, 15);
+    pipeline.generate(std::vector<Vec3i>{ Vec3i(0, 0, 0) }, pool, 15);
+    // (0, 0, 0) decorated (1, 0, 0) after it was lit
+    EXPECT_EQ(pipeline.getLateWriteCount(), size_t(1));
+
+    Chunk first(Vec3i(-1, 0, 0)), second(Vec3i(0, 0, 0));
+    pipeline.generate(std::vector<Vec3i>{ first.getPosition() }, pool, 15);
+    EXPECT_EQ(pipeline.getLateWriteCount(), size_t(2));
+    ASSERT_TRUE(pipeline.take(first));
+    ASSERT_TRUE(pipeline.take(second));
+    // (-2, 0, 0) decorates the taken (-1, 0, 0)
+    pipeline.generate(std::vector<Vec3i>{ Vec3i(-2, 0, 0) }, pool, 15);
+    EXPECT_EQ(pipeline.getLateWriteCount(), size_t(3));
+    EXPECT_EQ(pipelineViolations, 0);
+}
+
+//***********ChunkLoader***********//
+#include <chunkloader.h>
+#include <pluginmanager.h>
+namespace
+{
+    int batchCalls = 0;
+
+    void NWAPICALL countingBatchGen(const Vec3i* pos, BlockData* const* blocks, int count, int daylightBrightness)
+    {
+        batchCalls++;
+        for (int i = 0; i < count; i++) blocks[i][0] = BlockData(pos[i].x + 1, daylightBrightness, 0);
+    }
+}
+
+TEST(ChunkLoader, BatchedGenerator)
+{
+    ChunkBatchGenerator* oldBatchGen = ChunkBatchGen;
+    ChunkBatchGen = countingBatchGen;
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    std::vector<Chunk*> pointers;
+    for (int i = 0; i < 3; i++)
+    {
+        chunks.emplace_back(new Chunk(Vec3i(i, 0, 0)));
+        pointers.push_back(chunks.back().get());
+    }
+    ChunkLoader::buildBatch(pointers.data(), pointers.size(), 7);
+    EXPECT_EQ(batchCalls, 1);
+    for (int i = 0; i < 3; i++) EXPECT_EQ(chunks[i]->getBlocks()[0].getID(), i + 1);
+    // Single chunks go through the plain entry
+    ChunkLoader(*chunks[0]).build(7);
+    EXPECT_EQ(batchCalls, 1);
+    EXPECT_EQ(chunks[0]->getBlocks()[0].getID(), 0);
+    ChunkBatchGen = oldBatchGen;
+}
+
+TEST(ChunkLoader, UnloadResetsGenerator)
+{
+    PluginStats owner("test.generator");
+    ChunkGeneratorLoaded = true;
+    ChunkBatchGen = countingBatchGen;
+    ChunkGenFlags = 0;
+    ChunkGenOwner = &owner;
+    {
+        PluginManager plugins;
+        plugins.unloadPlugins();
+    }
+    EXPECT_FALSE(ChunkGeneratorLoaded);
+    EXPECT_EQ(ChunkBatchGen, nullptr);
+    EXPECT_EQ(ChunkGenOwner, nullptr);
+    EXPECT_EQ(ChunkGenFlags, ChunkGenReentrant);
+    // The default generator fills the chunk with daylight air
+    Chunk chunk(Vec3i(0, 0, 0));
+    ChunkLoader(chunk).build(9);
+    EXPECT_EQ(chunk.getBlocks()[0].getID(), 0);
+    EXPECT_EQ(chunk.getBlocks()[0].getBrightness(), 9);
+}
+
+//***********World***********//
+#include <boost/filesystem/operations.hpp>
+#include <world.h>
+#include <pluginmanager.h>
+TEST(World, BulkEdits)
+{
+    std::string name = "bulktest-" + boost::filesystem::unique_path().string();
+    {
+        PluginManager plugins;
+        BlockManager blocks;
+        // Without a save path the world is only kept in memory
+        World world(name, plugins, blocks);
+        EXPECT_EQ(world.getStorage(), nullptr);
+        for (int x = -1; x <= 0; x++)
+            for (int z = -1; z <= 0; z++)
+                world.addChunk(Vec3i(x, 0, z));
+        // The box crosses four loaded chunks and reaches into unloaded ones above and below
+        const Vec3i min(-30, -8, -3), max(5, 40, 2);
+        const BlockData stone(1, 0, 0), dirt(2, 0, 0);
+        size_t loaded = size_t(max.x - min.x + 1) * ChunkSize * size_t(max.z - min.z + 1);
+        EXPECT_EQ(world.fillBlocks(min, max, stone), loaded);
+        EXPECT_EQ(world.fillBlocks(min, max, stone), 0u);
+        EXPECT_EQ(world.getBlock(Vec3i(-30, 31, 2)).getID(), 1);
+        EXPECT_EQ(world.getBlock(Vec3i(-31, 0, 0)).getID(), 0);
+        EXPECT_EQ(world.getBlock(Vec3i(0, 0, 3)).getID(), 0);
+
+        // One column of the box
+        EXPECT_EQ(world.fillBlocks(Vec3i(1, 0, 1), Vec3i(1, 31, 1), dirt), size_t(ChunkSize));
+        EXPECT_EQ(world.replaceBlocks(min, max, 2, BlockData(3, 0, 0)), size_t(ChunkSize));
+        EXPECT_EQ(world.getBlock(Vec3i(1, 10, 1)).getID(), 3);
+
+        std::vector<BlockData> region(size_t(max.x - min.x + 1) * size_t(max.y - min.y + 1) * size_t(max.z - min.z + 1),
+                                      BlockData(7, 0, 0));
+        EXPECT_EQ(world.copyBlocksOut(min, max, region.data()), loaded);
+        size_t mismatches = 0;
+        Vec3i pos;
+        for (pos.x = min.x; pos.x <= max.x; pos.x++)
+            for (pos.y = min.y; pos.y <= max.y; pos.y++)
+                for (pos.z = min.z; pos.z <= max.z; pos.z++)
+                {
+                    BlockData expected = pos.y >= 0 && pos.y < ChunkSize ? world.getBlock(pos) : BlockData(7, 0, 0);
+                    size_t index = (size_t(pos.x - min.x) * size_t(max.y - min.y + 1) + size_t(pos.y - min.y))
+                                   * size_t(max.z - min.z + 1) + size_t(pos.z - min.z);
+                    if (region[index].getRawData() != expected.getRawData()) mismatches++;
+                }
+        EXPECT_EQ(mismatches, 0u);
+
+        // Copying the region back only changes the blocks which differ
+        EXPECT_EQ(world.copyBlocksIn(min, max, region.data()), 0u);
+        region[0] = dirt;
+        region[size_t(8) * size_t(max.z - min.z + 1)] = dirt;
+        EXPECT_EQ(world.copyBlocksIn(min, max, region.data()), 1u);
+        EXPECT_EQ(world.getBlock(Vec3i(-30, 0, -3)).getID(), 2);
+
+        std::vector<Vec3i> positions{ Vec3i(-30, 0, -3), Vec3i(1, 10, 1), Vec3i(0, 32, 0), Vec3i(-31, 0, 0) };
+        std::vector<BlockData> got(positions.size(), BlockData(7, 0, 0));
+        EXPECT_EQ(world.getBlocks(positions.data(), positions.size(), got.data()), 3u);
+        EXPECT_EQ(got[0].getID(), 2);
+        EXPECT_EQ(got[1].getID(), 3);
+        EXPECT_EQ(got[2].getID(), 7);
+        EXPECT_EQ(got[3].getID(), 0);
+
+        // Boxes far larger than the loaded area only visit the loaded chunks
+        const Vec3i lowest(INT32_MIN), highest(INT32_MAX);
+        EXPECT_EQ(world.fillBlocks(lowest, highest, BlockData(4, 0, 0)), size_t(4) * ChunkSize * ChunkSize * ChunkSize);
+        EXPECT_EQ(world.getBlock(Vec3i(-30, 0, -3)).getID(), 4);
+        EXPECT_EQ(world.getBlock(Vec3i(-32, 31, -32)).getID(), 4);
+    }
+    EXPECT_FALSE(boost::filesystem::exists("./worlds/" + name));
+}
+
+//***********WorldPregen***********//
+#include <worldpregen.h>
+TEST(WorldPregen, SavesEveryChunkAndResumes)
+{
+    namespace fs = boost::filesystem;
+    fs::path dir = fs::temp_directory_path() / fs::unique_path();
+    const Vec3i center(3, -1, 2);
+    const int radius = 1;
+    {
+        PluginManager plugins;
+        BlockManager blocks;
+        ThreadPool pool(4);
+        {
+            World world("pregentest", plugins, blocks, dir.string());
+            EXPECT_EQ(pregenerateWorld(world, pool, center, radius), 27u);
+            size_t missing = 0;
+            Vec3i pos;
+            for (pos.x = -radius - 1; pos.x <= radius + 1; pos.x++)
+                for (pos.y = -radius - 1; pos.y <= radius + 1; pos.y++)
+                    for (pos.z = -radius - 1; pos.z <= radius + 1; pos.z++)
+                    {
+                        bool inside = std::abs(pos.x) <= radius && std::abs(pos.y) <= radius && std::abs(pos.z) <= radius;
+                        if (world.getStorage()->hasChunk(center + pos) != inside) missing++;
+                    }
+            EXPECT_EQ(missing, 0u);
+            // Everything is saved already
+            EXPECT_EQ(pregenerateWorld(world, pool, center, radius), 0u);
+        }
+        // Resumed in a later run with a larger radius, only the new shell is generated
+        World world("pregentest", plugins, blocks, dir.string());
+        EXPECT_EQ(pregenerateWorld(world, pool, center, radius + 1), 125u - 27u);
+        EXPECT_EQ(pregenerateWorld(world, pool, center, radius + 1), 0u);
+    }
+    fs::remove_all(dir);
+}
+
+//***********PluginEvents***********//
+namespace
+{
+    struct EventCounter
+    {
+        int calls[PluginEventCount];
+        int64_t events[PluginEventCount];
+    };
+
+    template <PluginEvent Event>
+    void NWAPICALL countEvents(World*, const void* events, int32_t count, void* userData)
+    {
+        EventCounter& counter = *static_cast<EventCounter*>(userData);
+        counter.calls[int(Event)]++;
+        counter.events[int(Event)] += Event == PluginEvent::Tick ? *static_cast<const int64_t*>(events) : count;
+    }
+}
+
+TEST(PluginEvents, BatchedPerTick)
+{
+    constexpr int Subscribers = 20;
+    {
+        PluginManager plugins;
+        BlockManager blocks;
+        World world("eventtest", plugins, blocks);
+        PluginEvents& events = plugins.getEvents();
+        // Nothing is recorded without subscribers
+        world.addChunk(Vec3i(0, 0, 0));
+        world.fillBlocks(Vec3i(0, 0, 0), Vec3i(ChunkSize - 1), BlockData(1, 0, 0));
+
+        EventCounter counter = {};
+        std::vector<int32_t> subscriptions;
+        for (int i = 0; i < Subscribers; i++)
+        {
+            subscriptions.push_back(events.subscribe(int(PluginEvent::BlockChanged), countEvents<PluginEvent::BlockChanged>, &counter));
+            subscriptions.push_back(events.subscribe(int(PluginEvent::ChunkLoaded), countEvents<PluginEvent::ChunkLoaded>, &counter));
+            subscriptions.push_back(events.subscribe(int(PluginEvent::ChunkUnloaded), countEvents<PluginEvent::ChunkUnloaded>, &counter));
+        }
+        subscriptions.push_back(events.subscribe(int(PluginEvent::Tick), countEvents<PluginEvent::Tick>, &counter));
+        EXPECT_EQ(events.subscribe(PluginEventCount, countEvents<PluginEvent::Tick>, &counter), -1);
+        world.update();
+        EXPECT_EQ(counter.calls[int(PluginEvent::BlockChanged)], 0);
+
+        for (int x = 1; x <= 3; x++) world.addChunk(Vec3i(x, 0, 0));
+        world.deleteChunk(Vec3i(3, 0, 0));
+        size_t changed = world.fillBlocks(Vec3i(0, 0, 0), Vec3i(3 * ChunkSize - 1, ChunkSize - 1, ChunkSize - 1), BlockData(2, 0, 0));
+        world.setBlock(Vec3i(5, 5, 5), BlockData(3, 0, 0));
+        world.update();
+        events.tick();
+        // One call per subscriber and event, whatever the number of events
+        EXPECT_EQ(counter.calls[int(PluginEvent::BlockChanged)], Subscribers);
+        EXPECT_EQ(counter.events[int(PluginEvent::BlockChanged)], int64_t(changed + 1) * Subscribers);
+        EXPECT_EQ(counter.calls[int(PluginEvent::ChunkLoaded)], Subscribers);
+        EXPECT_EQ(counter.events[int(PluginEvent::ChunkLoaded)], 3 * Subscribers);
+        EXPECT_EQ(counter.calls[int(PluginEvent::ChunkUnloaded)], Subscribers);
+        EXPECT_EQ(counter.events[int(PluginEvent::ChunkUnloaded)], Subscribers);
+        EXPECT_EQ(counter.calls[int(PluginEvent::Tick)], 1);
+
+        // Events may be recorded by worker threads
+        constexpr int Threads = 4, ChangesPerThread = 1000;
+        std::vector<std::thread> threads;
+        for (int i = 0; i < Threads; i++)
+            threads.emplace_back([&world, i]()
+            {
+                for (int j = 0; j < ChangesPerThread; j++) world.getEvents().blockChanged(Vec3i(i, j, 0), BlockData(4, 0, 0));
+            });
+        for (std::thread& thread : threads) thread.join();
+        world.update();
+        EXPECT_EQ(counter.calls[int(PluginEvent::BlockChanged)], 2 * Subscribers);
+        EXPECT_EQ(counter.events[int(PluginEvent::BlockChanged)], int64_t(changed + 1 + Threads * ChangesPerThread) * Subscribers);
+
+        // Nothing is delivered twice, and cancelled subscriptions get nothing
+        for (int32_t id : subscriptions) EXPECT_TRUE(events.unsubscribe(id));
+        EXPECT_FALSE(events.unsubscribe(subscriptions[0]));
+        world.setBlock(Vec3i(6, 6, 6), BlockData(3, 0, 0));
+        world.update();
+        events.tick();
+        EXPECT_EQ(counter.calls[int(PluginEvent::BlockChanged)], 2 * Subscribers);
+        EXPECT_EQ(counter.calls[int(PluginEvent::Tick)], 1);
+    }
+}
+
+//***********PluginStats***********//
+namespace
+{
+    void NWAPICALL slowHandler(World*, const void*, int32_t, void* userData)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(*static_cast<int*>(userData)));
+    }
+}
+
+TEST(PluginStats, AttributesCallbacksToPlugins)
+{
+    PluginStats fast("test.fast"), slow("test.slow");
+    PluginEvents events;
+    int fastDelay = 0, slowDelay = 20;
+    {
+        // Handlers registered while a plugin runs belong to it
+        PluginCall init(&fast, "init()");
+        EXPECT_EQ(PluginCall::getCurrent(), &fast);
+        events.subscribe(int(PluginEvent::Tick), slowHandler, &fastDelay);
+        {
+            PluginCall nested(&slow, "init()");
+            events.subscribe(int(PluginEvent::Tick), slowHandler, &slowDelay);
+        }
+        EXPECT_EQ(PluginCall::getCurrent(), &fast);
+    }
+    EXPECT_EQ(PluginCall::getCurrent(), nullptr);
+    EXPECT_EQ(fast.calls, 1u);
+
+    PluginCall::setBudget(std::chrono::milliseconds(10));
+    for (int i = 0; i < 3; i++) events.tick();
+    PluginCall::setBudget(std::chrono::milliseconds(DefaultPluginCallBudgetMs));
+    EXPECT_EQ(fast.calls, 4u);
+    EXPECT_EQ(fast.slowCalls, 0u);
+    EXPECT_EQ(slow.calls, 4u);
+    EXPECT_EQ(slow.slowCalls, 3u);
+    EXPECT_GE(slow.nanoseconds, uint64_t(3 * 20 * 1000000));
+    EXPECT_GE(slow.maxNanoseconds, uint64_t(20 * 1000000));
+}
+
+//***********PluginTasks***********//
+#include <plugintasks.h>
+#include <threadpool.h>
+namespace
+{
+    struct TaskRecord
+    {
+        std::atomic<int> jobs, completions;
+        std::atomic<bool> release;
+        std::thread::id completionThread;
+    };
+
+    void NWAPICALL recordJob(void* userData)
+    {
+        TaskRecord& record = *static_cast<TaskRecord*>(userData);
+        while (!record.release) std::this_thread::yield();
+        record.jobs++;
+    }
+
+    void NWAPICALL recordCompletion(void* userData)
+    {
+        TaskRecord& record = *static_cast<TaskRecord*>(userData);
+        record.completionThread = std::this_thread::get_id();
+        record.completions++;
+    }
+}
+
+TEST(PluginTasks, AsyncJobsCompleteOnTick)
+{
+    PluginTasks tasks;
+    TaskRecord record = {};
+    record.release = true;
+    // No workers, no async jobs
+    EXPECT_EQ(tasks.scheduleAsync(recordJob, recordCompletion, &record), -1);
+
+    ThreadPool pool(2);
+    tasks.setThreadPool(&pool);
+    PluginStats plugin("test.tasks");
+    {
+        PluginCall init(&plugin, "init()");
+        for (int i = 0; i < 10; i++) EXPECT_GE(tasks.scheduleAsync(recordJob, recordCompletion, &record), 0);
+        EXPECT_GE(tasks.scheduleOnTick(recordCompletion, 1, &record), 0);
+    }
+    pool.wait();
+    EXPECT_EQ(record.jobs, 10);
+    EXPECT_EQ(record.completions, 0); // Only delivered by the tick thread
+    tasks.tick();
+    EXPECT_EQ(record.completions, 10);
+    EXPECT_EQ(record.completionThread, std::this_thread::get_id());
+    tasks.tick(); // The tick job is due now
+    EXPECT_EQ(record.completions, 11);
+    EXPECT_EQ(tasks.getPendingCount(), 0u);
+    EXPECT_EQ(plugin.calls, 22u);
+
+    // Cancelled tasks don't complete
+    int32_t cancelled = tasks.scheduleOnTick(recordCompletion, 0, &record);
+    EXPECT_TRUE(tasks.cancel(cancelled));
+    EXPECT_FALSE(tasks.cancel(cancelled));
+    tasks.tick();
+    EXPECT_EQ(record.completions, 11);
+
+    // Unloading a plugin waits for its running jobs and drops the rest
+    record.release = false;
+    {
+        PluginCall init(&plugin, "init()");
+        for (int i = 0; i < 4; i++) tasks.scheduleAsync(recordJob, recordCompletion, &record);
+        tasks.scheduleOnTick(recordCompletion, 0, &record);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::thread releaser([&record]
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        record.release = true;
+    });
+    tasks.cancelAll(&plugin);
+    // Both workers were busy with a job, which had to finish before cancelAll() returned
+    EXPECT_EQ(record.jobs, 12);
+    releaser.join();
+    pool.wait();
+    tasks.tick();
+    EXPECT_EQ(record.jobs, 12);
+    EXPECT_EQ(record.completions, 11);
+    EXPECT_EQ(tasks.getPendingCount(), 0u);
+    tasks.setThreadPool(nullptr);
+}
+
+//***********PacketBuffer***********//
+#include <packetbuffer.h>
+TEST(PacketBuffer, PooledAndShared)
+{
+    {
+        PacketBuffer buffer(100);
+        ASSERT_NE(buffer.data(), nullptr);
+        EXPECT_EQ(buffer.size(), 100u);
+        EXPECT_GE(buffer.capacity(), 100u);
+        memset(buffer.data(), 0x5a, buffer.size());
+        PacketBuffer copy = buffer;
+        EXPECT_FALSE(buffer.unique());
+        EXPECT_EQ(copy.data(), buffer.data());
+        buffer = PacketBuffer();
+        EXPECT_TRUE(copy.unique());
+        EXPECT_EQ(copy.data()[99], 0x5a);
+    }
+    EXPECT_EQ(PacketBuffer().data(), nullptr);
+    EXPECT_EQ(PacketBuffer(0).capacity(), 0u);
+
+    // Once the pools are warm, packets of any pooled size don't touch the heap
+    const size_t sizes[] = { 8, 60, 300, 5000, 70000 };
+    auto churn = [&sizes]
+    {
+        std::vector<PacketBuffer> inFlight;
+        for (int i = 0; i < 1000; i++)
+        {
+            inFlight.emplace_back(sizes[i % 5]);
+            if (inFlight.size() > 3) inFlight.erase(inFlight.begin());
+        }
+    };
+    churn();
+    size_t allocations = PacketBuffer::getHeapAllocations();
+    churn();
+    EXPECT_EQ(PacketBuffer::getHeapAllocations(), allocations);
+
+    // Buffers larger than the largest pool are not kept
+    allocations = PacketBuffer::getHeapAllocations();
+    for (int i = 0; i < 3; i++) PacketBuffer large(4 << 20);
+    EXPECT_EQ(PacketBuffer::getHeapAllocations(), allocations + 3);
+}
+
+//***********PacketReader***********//
+#include <packetreader.h>
+TEST(PacketReader, FramesPartialAndOversized)
+{
+    // A stream of small packets and one larger than the receive buffer, received in random pieces
+    std::vector<char> stream;
+    std::vector<std::pair<uint32_t, uint32_t>> sent;
+    std::mt19937 rng(7);
+    for (uint32_t i = 0; i < 200; i++)
+    {
+        uint32_t length = i == 100 ? uint32_t(PacketReader::ReceiveSize * 5) : uint32_t(rng() % 100);
+        char bytes[PacketHeaderSize];
+        encodePacketHeader(PacketHeader{ i, length }, bytes);
+        stream.insert(stream.end(), bytes, bytes + PacketHeaderSize);
+        for (uint32_t j = 0; j < length; j++) stream.push_back(char(i + j));
+        sent.emplace_back(i, length);
+    }
+
+    PacketReader reader;
+    size_t received = 0, taken = 0;
+    while (received < stream.size())
+    {
+        size_t size;
+        char* space = reader.prepare(size);
+        ASSERT_GE(size, PacketReader::ReceiveSize);
+        size = std::min({ size, stream.size() - received, size_t(rng() % 3000 + 1) });
+        memcpy(space, stream.data() + received, size);
+        reader.commit(size);
+        received += size;
+        PacketHeader header;
+        const char* data;
+        while (reader.next(header, data))
+        {
+            ASSERT_LT(taken, sent.size());
+            EXPECT_EQ(header.identifier, sent[taken].first);
+            ASSERT_EQ(header.length, sent[taken].second);
+            bool same = true;
+            for (uint32_t j = 0; j < header.length; j++) same = same && data[j] == char(header.identifier + j);
+            EXPECT_TRUE(same);
+            taken++;
+        }
+    }
+    EXPECT_EQ(taken, sent.size());
+    EXPECT_EQ(reader.getBufferedBytes(), 0u);
+    EXPECT_FALSE(reader.isMalformed());
+    // The buffer grew for the large packet and shrinks back once it is taken
+    size_t size;
+    reader.prepare(size);
+    EXPECT_EQ(reader.getCapacity(), PacketReader::ReceiveSize * 2);
+
+    // A header claiming a large packet doesn't grow the buffer, only received bytes do
+    char* space = reader.prepare(size);
+    encodePacketHeader(PacketHeader{ 0, MaxPacketLength }, space);
+    reader.commit(PacketHeaderSize);
+    reader.prepare(size);
+    EXPECT_EQ(reader.getCapacity(), PacketReader::ReceiveSize * 2);
+
+    // Lengths are checked as soon as the header arrives, before any space is made for the packet
+    PacketReader limited(1000);
+    space = limited.prepare(size);
+    encodePacketHeader(PacketHeader{ 0, 0xffffffffu }, space);
+    limited.commit(PacketHeaderSize);
+    PacketHeader header;
+    const char* data;
+    EXPECT_FALSE(limited.next(header, data));
+    EXPECT_TRUE(limited.isMalformed());
+    limited.prepare(size);
+    EXPECT_LT(size, size_t(1) << 20);
+
+    // The limit can be raised, as sessions do after the login
+    PacketReader login(MaxLoginPacketLength);
+    space = login.prepare(size);
+    encodePacketHeader(PacketHeader{ 0, MaxLoginPacketLength + 1 }, space);
+    login.commit(PacketHeaderSize);
+    login.setMaxPacketLength(MaxPacketLength);
+    EXPECT_FALSE(login.next(header, data));
+    EXPECT_FALSE(login.isMalformed());
+}
+
+//***********PacketSchema***********//
+#include <deque>
+#include <networkstructures.h>
+TEST(PacketSchema, ExactLittleEndianLayout)
+{
+    LoginPacket login("ab", "xyz", 0x0102);
+    // Two length-prefixed strings and a uint16_t, no padding
+    EXPECT_EQ(login.getEncodedSize(), 4u + 2 + 4 + 3 + 2);
+    Packet packet = login.makePacket();
+    EXPECT_EQ(packet.identifier, Login);
+    ASSERT_EQ(packet.length, login.getEncodedSize());
+    const char expected[] = { 2, 0, 0, 0, 'a', 'b', 3, 0, 0, 0, 'x', 'y', 'z', 2, 1 };
+    EXPECT_EQ(memcmp(packet.data.data(), expected, sizeof(expected)), 0);
+
+    // Decoded from an odd address, strings point into the data
+    std::vector<char> unaligned(1 + sizeof(expected));
+    memcpy(unaligned.data() + 1, expected, sizeof(expected));
+    LoginPacket decoded;
+    ASSERT_TRUE(decoded.decode(unaligned.data() + 1, sizeof(expected)));
+    EXPECT_EQ(decoded.getUsername(), "ab");
+    EXPECT_EQ(decoded.getUsername().data(), unaligned.data() + 5);
+    EXPECT_EQ(decoded.getPassword(), "xyz");
+    EXPECT_EQ(decoded.getVersion(), 0x0102);
+
+    // Every truncation, trailing bytes and lengths past the end are rejected
+    for (uint32_t length = 0; length < sizeof(expected); length++) EXPECT_FALSE(decoded.decode(expected, length));
+    std::vector<char> trailing(expected, expected + sizeof(expected));
+    trailing.push_back(0);
+    EXPECT_FALSE(decoded.decode(trailing.data(), uint32_t(trailing.size())));
+    std::vector<char> overlong(expected, expected + sizeof(expected));
+    overlong[3] = char(0x80);
+    EXPECT_FALSE(decoded.decode(overlong.data(), uint32_t(overlong.size())));
+}
+
+//***********Server***********//
+#include <session.h>
+namespace
+{
+    // Stands in for Session, which needs a connected socket
+    struct QueueSession
+    {
+        std::deque<Packet> packets;
+
+        void addRequest(const Packet& packet)
+        {
+            packets.push_back(packet);
+        }
+    };
+}
+
+// A broadcast encodes once, each session queue only takes a reference, and disconnected sessions are dropped
+TEST(Server, BroadcastSharesDataAndPrunesSessions)
+{
+    std::vector<std::shared_ptr<QueueSession>> sessions;
+    std::vector<std::weak_ptr<QueueSession>> weakSessions;
+    for (int i = 0; i < 500; i++)
+    {
+        sessions.push_back(std::make_shared<QueueSession>());
+        weakSessions.push_back(sessions.back());
+    }
+    // Every third session disconnects
+    for (size_t i = 0; i < sessions.size(); i += 3) sessions[i].reset();
+    const size_t live = sessions.size() - (sessions.size() + 2) / 3;
+
+    Packet packet = ChatPacket("server", "block changed").makePacket();
+    size_t allocations = PacketBuffer::getHeapAllocations();
+    sendToAllSessions(weakSessions, packet);
+    EXPECT_EQ(PacketBuffer::getHeapAllocations(), allocations);
+    EXPECT_EQ(weakSessions.size(), live);
+    size_t queued = 0;
+    for (const auto& session : sessions)
+    {
+        if (!session) continue;
+        ASSERT_EQ(session->packets.size(), 1u);
+        EXPECT_EQ(session->packets.front().data.data(), packet.data.data());
+        queued++;
+    }
+    EXPECT_EQ(queued, live);
+    EXPECT_FALSE(packet.data.unique());
+
+    // Sessions which disconnect later are dropped by the next broadcast
+    sessions.clear();
+    EXPECT_TRUE(packet.data.unique());
+    sendToAllSessions(weakSessions, packet);
+    EXPECT_TRUE(weakSessions.empty());
+    EXPECT_TRUE(packet.data.unique());
+}
+
+//***********PacketDispatch***********//
+#include <packetdispatch.h>
+namespace
+{
+    struct PacketCounter
+    {
+        size_t logins = 0, chats = 0, contentBytes = 0;
+        std::string lastUsername, lastPassword;
+
+        void operator()(const LoginPacket& packet)
+        {
+            logins++;
+            lastUsername = packet.getUsername().to_string();
+            lastPassword = packet.getPassword().to_string();
+        }
+
+        void operator()(const ChatPacket& packet)
+        {
+            chats++;
+            contentBytes += packet.getContent().size();
+        }
+    };
+
+    void appendPacket(std::vector<char>& stream, const Packet& packet)
+    {
+        char header[PacketHeaderSize];
+        encodePacketHeader(PacketHeader{ uint32_t(packet.identifier), packet.length }, header);
+        stream.insert(stream.end(), header, header + PacketHeaderSize);
+        stream.insert(stream.end(), packet.data.data(), packet.data.data() + packet.length);
+    }
+}
+
+TEST(PacketDispatch, TableDrivenAndRejecting)
+{
+    PacketCounter counter;
+    Packet login = LoginPacket("steve", "hunter2", 41).makePacket();
+    PacketHeader header = { uint32_t(login.identifier), login.length };
+    EXPECT_EQ(dispatchPacket(header, login.data.data(), counter), DispatchResult::handled);
+    EXPECT_EQ(counter.logins, 1u);
+    EXPECT_EQ(counter.lastUsername, "steve");
+    EXPECT_EQ(counter.lastPassword, "hunter2");
+    // Truncated packets and unknown identifiers are rejected, not handled
+    header.length--;
+    EXPECT_EQ(dispatchPacket(header, login.data.data(), counter), DispatchResult::malformed);
+    header = { 12345, 0 };
+    EXPECT_EQ(dispatchPacket(header, nullptr, counter), DispatchResult::unknown);
+    EXPECT_EQ(counter.logins, 1u);
+
+    // Small chat packets through the framer and the dispatcher
+    constexpr size_t Packets = 2000000;
+    std::vector<char> stream;
+    for (size_t i = 0; i < 1000; i++) appendPacket(stream, ChatPacket("alex", "hello, world").makePacket());
+    PacketReader reader;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t sent = 0; sent < Packets; sent += 1000)
+    {
+        for (size_t offset = 0; offset < stream.size();)
+        {
+            size_t size;
+            char* space = reader.prepare(size);
+            size = std::min(size, stream.size() - offset);
+            memcpy(space, stream.data() + offset, size);
+            reader.commit(size);
+            offset += size;
+            const char* data;
+            while (reader.next(header, data)) ASSERT_EQ(dispatchPacket(header, data, counter), DispatchResult::handled);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    EXPECT_EQ(counter.chats, Packets);
+    EXPECT_EQ(counter.contentBytes, Packets * 12);
+    std::cout << "[ PacketDispatch ] " << Packets / seconds / 1e6 << "M packets/s" << std::endl;
+}
+
+//***********PluginAPI***********//
+#include <pluginapi.h>
+TEST(PluginAPI, BlockDataLayout)
+{
+    // Both sides of the plugin boundary must agree on every bit, not only on the size
+    PluginAPI::NWblockdata block;
+    block.id = 0xabc;
+    block.brightness = 0x5;
+    block.state = 0x1234;
+    const BlockData* converted = PluginAPI::convertBlockData(&block);
+    EXPECT_EQ(converted->getID(), 0xabc);
+    EXPECT_EQ(converted->getBrightness(), 0x5);
+    EXPECT_EQ(converted->getState(), 0x1234);
+    PluginAPI::NWblockdata back = PluginAPI::convertBlockData(BlockData(0x123, 0xa, 0xbeef));
+    EXPECT_EQ(back.id, 0x123u);
+    EXPECT_EQ(back.brightness, 0xau);
+    EXPECT_EQ(back.state, 0xbeefu);
+}
+
+TEST(PluginAPI, RejectsInvalidArguments)
+{
+    PluginManager plugins;
+    BlockManager blocks;
+    World world("apitest", plugins, blocks);
+    world.addChunk(Vec3i(0, 0, 0));
+    // Called the way plugins see the API
+    NWworld* handle = reinterpret_cast<NWworld*>(&world);
+    NWvec3i pos{ 1, 2, 3 };
+    NWblockdata block{ 7, 0, 0 };
+    EXPECT_EQ(nwWorldGetBlocks(handle, &pos, -1, &block), -1);
+    EXPECT_EQ(nwWorldGetBlocks(handle, nullptr, 1, &block), -1);
+    EXPECT_EQ(block.id, 7u);
+    EXPECT_EQ(nwWorldGetBlocks(handle, nullptr, 0, nullptr), 0);
+    EXPECT_EQ(nwWorldGetBlocks(handle, &pos, 1, &block), 1);
+    EXPECT_EQ(block.id, 0u);
+
+    std::vector<uint8_t> data(NW_ATTACHMENT_MAX_LENGTH + 1, 1);
+    EXPECT_EQ(nwSetAttachment(handle, &pos, 1, data.data(), -1), 2);
+    EXPECT_EQ(nwSetAttachment(handle, &pos, 1, nullptr, 4), 2);
+    EXPECT_EQ(nwSetAttachment(handle, &pos, 1, data.data(), int32_t(data.size())), 2);
+    EXPECT_EQ(nwGetAttachment(handle, &pos, 1, nullptr, 0), -1);
+    EXPECT_EQ(nwSetAttachment(handle, &pos, 1, data.data(), NW_ATTACHMENT_MAX_LENGTH), 0);
+    EXPECT_EQ(nwGetAttachment(handle, &pos, 1, nullptr, 0), NW_ATTACHMENT_MAX_LENGTH);
+    EXPECT_EQ(nwGetAttachment(handle, &pos, 1, nullptr, 4), -2);
+    EXPECT_EQ(nwGetAttachment(handle, &pos, 1, data.data(), -4), -2);
+
+    NWvec3i min{ 0, 0, 0 }, max{ 1, 1, 1 };
+    EXPECT_EQ(nwFillColumn(nullptr, 0, 0, 0, 1, block), -1);
+    EXPECT_EQ(nwFillBox(nullptr, &min, &max, block), -1);
+    EXPECT_EQ(nwFillBox(handle, nullptr, &max, block), -1);
+    EXPECT_EQ(nwReplaceBlocks(handle, &min, nullptr, 0, block), -1);
+    EXPECT_EQ(nwCopyRegionIn(handle, &min, &max, nullptr), -1);
+    EXPECT_EQ(nwCopyRegionOut(handle, &min, &max, nullptr), -1);
+    EXPECT_EQ(nwFillBox(handle, &min, &max, NWblockdata{ 1, 0, 0 }), 8);
+}
+
+//***********Session***********//
+#include <atomic>
+#include <functional>
+// The tests build Session from the shared sources and play the side which owns ioService.
+// Logins with the password "secret" are accepted.
+boost::asio::io_service ioService;
+
+namespace
+{
+    size_t sessionErrors = 0, sessionChats = 0;
+}
+
+void errorHandle(const tcp::socket&, boost::system::error_code)
+{
+    sessionErrors++;
+}
+
+void Session::doUpdate()
+{
+}
+
+bool LoginPacket::process() const
+{
+    return getPassword() == "secret";
+}
+
+bool ChatPacket::process() const
+{
+    sessionChats++;
+    return true;
+}
+
+namespace
+{
+    // A connected pair of loopback sockets
+    struct SocketPair
+    {
+        tcp::socket local, remote;
+
+        SocketPair() : local(ioService), remote(ioService)
+        {
+            tcp::acceptor acceptor(ioService, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+            remote.connect(acceptor.local_endpoint());
+            acceptor.accept(local);
+        }
+    };
+
+    void writePacket(tcp::socket& socket, const Packet& packet)
+    {
+        char header[PacketHeaderSize];
+        encodePacketHeader(PacketHeader{ uint32_t(packet.identifier), packet.length }, header);
+        boost::asio::write(socket, boost::asio::buffer(header));
+        boost::asio::write(socket, boost::asio::buffer(packet.data.data(), packet.length));
+    }
+
+    // Run the network loop until `done` returns true, at most a few seconds
+    bool runUntil(const std::function<bool()>& done)
+    {
+        ioService.restart();
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!done() && std::chrono::steady_clock::now() < deadline)
+            ioService.run_one_for(std::chrono::milliseconds(100));
+        return done();
+    }
+
+    // Close the remote socket and let the session see it, so nothing is left for the next test
+    void disconnect(SocketPair& sockets)
+    {
+        sockets.remote.close();
+        ioService.restart();
+        ioService.run();
+    }
+}
+
+// Sessions only take full-sized packets once the login is accepted
+TEST(Session, LimitLiftedAfterAcceptedLogin)
+{
+    const std::string content(MaxLoginPacketLength * 2, 'x');
+    for (bool accepted : { false, true })
+    {
+        SocketPair sockets;
+        std::make_shared<Session>(std::move(sockets.local), MaxLoginPacketLength)->start();
+        sessionErrors = sessionChats = 0;
+        writePacket(sockets.remote, LoginPacket("player", accepted ? "secret" : "wrong", 1).makePacket());
+        writePacket(sockets.remote, ChatPacket("player", content).makePacket());
+        EXPECT_TRUE(runUntil([] { return sessionErrors + sessionChats != 0; }));
+        EXPECT_EQ(sessionChats, accepted ? 1u : 0u);
+        EXPECT_EQ(sessionErrors, accepted ? 0u : 1u);
+        disconnect(sockets);
+    }
+}
+
+// Queued packets arrive framed and in order, whatever writes they are grouped in
+TEST(Session, FlushesQueuedPacketsInOrder)
+{
+    SocketPair sockets;
+    auto session = std::make_shared<Session>(std::move(sockets.local));
+    session->start();
+    // Small packets around one larger than a flush, which is sent alone
+    std::vector<Packet> sent;
+    for (uint32_t i = 0; i < 2000; i++)
+    {
+        std::string content(i == 700 ? MaxFlushBytes * 2 : i % 300, char('a' + i % 26));
+        sent.push_back(ChatPacket("server", content).makePacket());
+    }
+    // The first half is queued at once, the rest while the first writes are running
+    for (size_t i = 0; i < sent.size() / 2; i++) session->addRequest(sent[i]);
+
+    PacketReader reader;
+    size_t taken = 0, mismatches = 0;
+    std::function<void()> read = [&]()
+    {
+        size_t size;
+        char* space = reader.prepare(size);
+        sockets.remote.async_read_some(boost::asio::buffer(space, size), [&](boost::system::error_code ec, size_t bytes)
+        {
+            if (ec) return;
+            reader.commit(bytes);
+            PacketHeader header;
+            const char* data;
+            while (reader.next(header, data))
+            {
+                if (taken == 0)
+                    for (size_t i = sent.size() / 2; i < sent.size(); i++) session->addRequest(sent[i]);
+                if (taken >= sent.size() || header.identifier != uint32_t(Chat) || header.length != sent[taken].length ||
+                    memcmp(data, sent[taken].data.data(), header.length) != 0)
+                    mismatches++;
+                taken++;
+            }
+            read();
+        });
+    };
+    read();
+    EXPECT_TRUE(runUntil([&] { return taken >= sent.size(); }));
+    EXPECT_EQ(taken, sent.size());
+    EXPECT_EQ(mismatches, 0u);
+    EXPECT_FALSE(reader.isMalformed());
+    EXPECT_EQ(reader.getBufferedBytes(), 0u);
+    disconnect(sockets);
+}
+
 int main(int argc, char* argv[])
 {
     testing::InitGoogleTest(&argc, argv);